@@ -0,0 +1,82 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+// Minimal helpers for the compiled map format.
+// Values are stored in native byte order, arrays as an element count followed by the raw elements.
+
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::ostream &out) : m_out(out) {}
+
+    template<typename T>
+    void value(const T &v) {
+        m_out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+    }
+
+    template<typename T>
+    void array(const std::vector<T> &v) {
+        value<uint64_t>(v.size());
+        if (!v.empty()) {
+            m_out.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+        }
+    }
+
+    bool good() const { return m_out.good(); }
+
+private:
+    std::ostream &m_out;
+};
+
+// Reads from a memory block, e.g. a mapped file. Every read checks the remaining size,
+// after the first failure all further reads fail as well.
+class BinaryReader {
+public:
+    BinaryReader(const char *data, size_t size) : m_pos(data), m_end(data + size), m_ok(true) {}
+
+    template<typename T>
+    bool value(T &v) {
+        if (!take(sizeof(T))) {
+            return false;
+        }
+        memcpy(&v, m_pos - sizeof(T), sizeof(T));
+        return true;
+    }
+
+    template<typename T>
+    bool array(std::vector<T> &v) {
+        uint64_t n = 0;
+        if (!value(n) || n > (uint64_t) (m_end - m_pos) / sizeof(T)) {
+            m_ok = false;
+            return false;
+        }
+        v.resize(n);
+        if (n > 0) {
+            memcpy(v.data(), m_pos, n * sizeof(T));
+        }
+        m_pos += n * sizeof(T);
+        return true;
+    }
+
+    bool ok() const { return m_ok; }
+
+private:
+    bool take(size_t n) {
+        if (!m_ok || (size_t) (m_end - m_pos) < n) {
+            m_ok = false;
+            return false;
+        }
+        m_pos += n;
+        return true;
+    }
+
+    const char *m_pos;
+    const char *m_end;
+    bool m_ok;
+};
+
+#endif /* BINARY_IO_H */
@@ -0,0 +1,173 @@
+#ifndef CENTERLINE_H
+#define CENTERLINE_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "binary_io.h"
+#include "spline.h"
+
+// Default spacing of the samples in the dense centerline table
+const double kDefaultCenterlineDs = 0.5;
+
+// Newton steps of the Frenet projection, fixed so its cost is bounded
+const int kProjectIterations = 4;
+
+// Smooth track centerline sampled at a uniform s spacing.
+// Periodic splines x(s), y(s), dx(s) and dy(s) are fitted through the waypoints once,
+// afterwards a lookup is an index computation and a linear interpolation
+// between two neighbouring samples.
+class Centerline {
+public:
+    // samples, the last one repeats the first so interpolation across the seam needs no wrap
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> dx;
+    std::vector<double> dy;
+
+    Centerline() : m_ds(kDefaultCenterlineDs), m_inv_ds(1.0 / kDefaultCenterlineDs), m_length(0) {}
+
+    double ds() const { return m_ds; }
+
+    double length() const { return m_length; }
+
+    bool empty() const { return x.empty(); }
+
+    // max_s is the length of the closed loop, ds the sample spacing
+    void build(const std::vector<double> &map_x, const std::vector<double> &map_y,
+               const std::vector<double> &map_s, const std::vector<double> &map_dx,
+               const std::vector<double> &map_dy, double max_s, double ds) {
+        x.clear();
+        y.clear();
+        dx.clear();
+        dy.clear();
+        int n = map_x.size();
+        if (n < 3 || max_s <= 0 || ds <= 0) {
+            return;
+        }
+
+        // periodic fits, so the centerline is smooth across the seam
+        tk::periodic_spline spline_x, spline_y, spline_dx, spline_dy;
+        spline_x.set_points(map_s, map_x, max_s);
+        spline_y.set_points(map_s, map_y, max_s);
+        spline_dx.set_points(map_s, map_dx, max_s);
+        spline_dy.set_points(map_s, map_dy, max_s);
+
+        int samples = (int) ceil(max_s / ds);
+        m_ds = max_s / samples;
+        m_inv_ds = 1.0 / m_ds;
+        m_length = max_s;
+        x.resize(samples + 1);
+        y.resize(samples + 1);
+        dx.resize(samples + 1);
+        dy.resize(samples + 1);
+        for (int i = 0; i < samples; i++) {
+            double s = i * m_ds;
+            x[i] = spline_x(s);
+            y[i] = spline_y(s);
+            // the fitted normal is not unit length between waypoints
+            double n_x = spline_dx(s);
+            double n_y = spline_dy(s);
+            double len = sqrt(n_x * n_x + n_y * n_y);
+            dx[i] = n_x / len;
+            dy[i] = n_y / len;
+        }
+        x[samples] = x[0];
+        y[samples] = y[0];
+        dx[samples] = dx[0];
+        dy[samples] = dy[0];
+    }
+
+    // Takes over count samples computed elsewhere, e.g. compiled into the binary,
+    // including the repeated first sample at the end. length is the length of the loop.
+    void assign(const double *sample_x, const double *sample_y, const double *sample_dx, const double *sample_dy,
+                size_t count, double length) {
+        x.assign(sample_x, sample_x + count);
+        y.assign(sample_y, sample_y + count);
+        dx.assign(sample_dx, sample_dx + count);
+        dy.assign(sample_dy, sample_dy + count);
+        m_length = length;
+        m_ds = length / (count - 1);
+        m_inv_ds = 1.0 / m_ds;
+    }
+
+    void save(BinaryWriter &out) const {
+        out.value(m_ds);
+        out.value(m_length);
+        out.array(x);
+        out.array(y);
+        out.array(dx);
+        out.array(dy);
+    }
+
+    bool load(BinaryReader &in) {
+        in.value(m_ds);
+        in.value(m_length);
+        in.array(x);
+        in.array(y);
+        in.array(dx);
+        in.array(dy);
+        m_inv_ds = 1.0 / m_ds;
+        return in.ok() && m_ds > 0 && x.size() >= 2 && y.size() == x.size() && dx.size() == x.size() &&
+               dy.size() == x.size();
+    }
+
+    // Cartesian x,y of a wrapped s in [0, max_s) and lateral offset d
+    void to_xy(double s, double d, double &out_x, double &out_y) const {
+        double pos = s * m_inv_ds;
+        int i = std::min((int) pos, (int) x.size() - 2);
+        double t = pos - i;
+        double c_x = x[i] + t * (x[i + 1] - x[i]);
+        double c_y = y[i] + t * (y[i + 1] - y[i]);
+        double n_x = dx[i] + t * (dx[i + 1] - dx[i]);
+        double n_y = dy[i] + t * (dy[i + 1] - dy[i]);
+        out_x = c_x + d * n_x;
+        out_y = c_y + d * n_y;
+    }
+
+    // Inverse of to_xy: finds s,d with to_xy(s, d) == px,py by Newton iteration.
+    // s holds the starting guess (e.g. the s of the previous frame) and receives the result,
+    // d is derived from it. Within a sample interval the mapping is bilinear in s and d,
+    // so a guess a few meters off converges in the fixed number of steps.
+    // Returns the squared length of the last step, which is large when the guess was too far off.
+    double project(double px, double py, double &s, double &d) const {
+        double step2 = 0;
+        d = 0;
+        for (int k = 0; k <= kProjectIterations; k++) {
+            s -= m_length * floor(s / m_length);
+            double pos = s * m_inv_ds;
+            int i = std::max(0, std::min((int) pos, (int) x.size() - 2));
+            double t = pos - i;
+            double c_x = x[i] + t * (x[i + 1] - x[i]);
+            double c_y = y[i] + t * (y[i + 1] - y[i]);
+            double n_x = dx[i] + t * (dx[i + 1] - dx[i]);
+            double n_y = dy[i] + t * (dy[i + 1] - dy[i]);
+            if (k == 0) {
+                // start with the offset along the normal at the guess
+                d = (px - c_x) * n_x + (py - c_y) * n_y;
+            }
+            if (k == kProjectIterations) {
+                break;
+            }
+            // Jacobian of to_xy, columns d/ds and d/dd
+            double a_x = (x[i + 1] - x[i] + d * (dx[i + 1] - dx[i])) * m_inv_ds;
+            double a_y = (y[i + 1] - y[i] + d * (dy[i + 1] - dy[i])) * m_inv_ds;
+            double r_x = px - (c_x + d * n_x);
+            double r_y = py - (c_y + d * n_y);
+            double inv_det = 1.0 / (a_x * n_y - a_y * n_x);
+            double step_s = (r_x * n_y - r_y * n_x) * inv_det;
+            double step_d = (a_x * r_y - a_y * r_x) * inv_det;
+            s += step_s;
+            d += step_d;
+            step2 = step_s * step_s + step_d * step_d;
+        }
+        return step2;
+    }
+
+private:
+    double m_ds;
+    double m_inv_ds;
+    double m_length;
+};
+
+#endif /* CENTERLINE_H */
@@ -0,0 +1,97 @@
+#ifndef CENTERLINE_COMPACT_H
+#define CENTERLINE_COMPACT_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "centerline.h"
+
+// Reduced precision copy of a Centerline with half its cache footprint.
+// Positions are int32 fixed point offsets from the origin of the table,
+// normals are float32, interpolation still runs in double.
+//
+// Error bounds against the double table, per looked up point:
+//  - position:  kCompactQuantum / 2 per coordinate (0.12 mm), for tables up to
+//               2^31 * kCompactQuantum (524 km) across
+//  - normal:    2^-24 relative per component, so |d| * 2^-24 for the lateral
+//               offset (below 1 um for any lane on the road)
+// so |error| <= sqrt(2) * (kCompactQuantum / 2 + |d| * 2^-24) in x,y.
+// map_validate checks this bound against the double reference.
+
+// Fixed point resolution of the positions in meters
+const double kCompactQuantum = 1.0 / 4096;
+
+class CompactCenterline {
+public:
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    std::vector<float> dx;
+    std::vector<float> dy;
+
+    CompactCenterline() : m_origin_x(0), m_origin_y(0), m_inv_ds(1), m_length(0) {}
+
+    bool empty() const { return x.empty(); }
+
+    double length() const { return m_length; }
+
+    // Upper bound of the distance to the double table for a lateral offset d
+    static double error_bound(double d) {
+        return sqrt(2.0) * (kCompactQuantum / 2 + fabs(d) * ldexp(1.0, -24));
+    }
+
+    // Quantizes a double table, returns false if it does not fit into the fixed point range
+    bool build(const Centerline &centerline) {
+        x.clear();
+        y.clear();
+        dx.clear();
+        dy.clear();
+        if (centerline.empty()) {
+            return false;
+        }
+        m_origin_x = *std::min_element(centerline.x.begin(), centerline.x.end());
+        m_origin_y = *std::min_element(centerline.y.begin(), centerline.y.end());
+        double max_x = *std::max_element(centerline.x.begin(), centerline.x.end());
+        double max_y = *std::max_element(centerline.y.begin(), centerline.y.end());
+        double range = ldexp(1.0, 31) * kCompactQuantum;
+        if (max_x - m_origin_x >= range || max_y - m_origin_y >= range) {
+            return false;
+        }
+
+        size_t n = centerline.x.size();
+        x.resize(n);
+        y.resize(n);
+        dx.resize(n);
+        dy.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            x[i] = (int32_t) lround((centerline.x[i] - m_origin_x) / kCompactQuantum);
+            y[i] = (int32_t) lround((centerline.y[i] - m_origin_y) / kCompactQuantum);
+            dx[i] = (float) centerline.dx[i];
+            dy[i] = (float) centerline.dy[i];
+        }
+        m_inv_ds = 1.0 / centerline.ds();
+        m_length = centerline.length();
+        return true;
+    }
+
+    // Cartesian x,y of a wrapped s in [0, length) and lateral offset d, see Centerline::to_xy
+    void to_xy(double s, double d, double &out_x, double &out_y) const {
+        double pos = s * m_inv_ds;
+        int i = std::min((int) pos, (int) x.size() - 2);
+        double t = pos - i;
+        double c_x = (x[i] + t * (x[i + 1] - x[i])) * kCompactQuantum;
+        double c_y = (y[i] + t * (y[i + 1] - y[i])) * kCompactQuantum;
+        double n_x = dx[i] + t * (dx[i + 1] - dx[i]);
+        double n_y = dy[i] + t * (dy[i + 1] - dy[i]);
+        out_x = m_origin_x + c_x + d * n_x;
+        out_y = m_origin_y + c_y + d * n_y;
+    }
+
+private:
+    double m_origin_x;
+    double m_origin_y;
+    double m_inv_ds;
+    double m_length;
+};
+
+#endif /* CENTERLINE_COMPACT_H */
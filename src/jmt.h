@@ -0,0 +1,117 @@
+#ifndef JMT_H
+#define JMT_H
+
+#include <cstddef>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/QR"
+
+// Horizons whose boundary matrix a JmtSolver keeps, the planner uses a handful
+const int kJmtCacheSize = 8;
+
+// Boundary condition of one Frenet coordinate (s or d): position, velocity, acceleration
+struct JmtState {
+    double p;
+    double v;
+    double a;
+};
+
+// p(t) = c[0] + c[1] t + c[2] t^2 + c[3] t^3 + c[4] t^4 + c[5] t^5
+struct Quintic {
+    double c[6];
+
+    double position(double t) const {
+        return c[0] + t * (c[1] + t * (c[2] + t * (c[3] + t * (c[4] + t * c[5]))));
+    }
+
+    double velocity(double t) const {
+        return c[1] + t * (2 * c[2] + t * (3 * c[3] + t * (4 * c[4] + t * 5 * c[5])));
+    }
+
+    double acceleration(double t) const {
+        return 2 * c[2] + t * (6 * c[3] + t * (12 * c[4] + t * 20 * c[5]));
+    }
+
+    double jerk(double t) const {
+        return 6 * c[3] + t * (24 * c[4] + t * 60 * c[5]);
+    }
+};
+
+// Jerk minimal trajectories of one Frenet coordinate: the quintic that goes from a start
+// to an end state in time T. The start state fixes c[0..2], the higher coefficients solve
+//
+//   | T^3    T^4     T^5   | |c3|   | end.p - (p + v T + a T^2 / 2) |
+//   | 3T^2   4T^3    5T^4  | |c4| = | end.v - (v + a T)             |
+//   | 6T     12T^2   20T^3 | |c5|   | end.a - a                     |
+//
+// The matrix only depends on T, so its inverse is factorized once per horizon and kept,
+// every further trajectory for that T is a 3x3 matrix vector product.
+class JmtSolver {
+public:
+    JmtSolver() : m_next(0) {}
+
+    // Trajectory from start to end in time T > 0
+    Quintic solve(const JmtState &start, const JmtState &end, double T) {
+        Quintic q;
+        solve(start, &end, 1, T, &q);
+        return q;
+    }
+
+    // Trajectories from one start to count end states, all in time T > 0,
+    // out[k] reaches end[k]. Sampling the end states of s and d separately and
+    // pairing them gives the candidates of a frame.
+    void solve(const JmtState &start, const JmtState *end, size_t count, double T, Quintic *out) {
+        const Eigen::Matrix3d &inv = inverse(T);
+        double T2 = T * T;
+        // end state reached without the higher terms
+        Eigen::Vector3d free_end(start.p + start.v * T + 0.5 * start.a * T2, start.v + start.a * T, start.a);
+        for (size_t k = 0; k < count; k++) {
+            Eigen::Vector3d rhs(end[k].p, end[k].v, end[k].a);
+            Eigen::Vector3d higher = inv * (rhs - free_end);
+            Quintic &q = out[k];
+            q.c[0] = start.p;
+            q.c[1] = start.v;
+            q.c[2] = 0.5 * start.a;
+            q.c[3] = higher[0];
+            q.c[4] = higher[1];
+            q.c[5] = higher[2];
+        }
+    }
+
+private:
+    // Inverse boundary matrix for horizon T, factorized on first use.
+    // Once the cache is full the oldest horizon is replaced.
+    const Eigen::Matrix3d &inverse(double T) {
+        for (size_t i = 0; i < m_horizons.size(); i++) {
+            if (m_horizons[i] == T) {
+                return m_inverses[i];
+            }
+        }
+        double T2 = T * T;
+        double T3 = T2 * T;
+        Eigen::Matrix3d m;
+        m << T3, T3 * T, T3 * T2,
+             3 * T2, 4 * T3, 5 * T3 * T,
+             6 * T, 12 * T2, 20 * T3;
+        Eigen::Matrix3d inv = m.colPivHouseholderQr().solve(Eigen::Matrix3d::Identity());
+
+        size_t slot;
+        if ((int) m_horizons.size() < kJmtCacheSize) {
+            slot = m_horizons.size();
+            m_horizons.push_back(T);
+            m_inverses.push_back(inv);
+        } else {
+            slot = m_next;
+            m_next = (m_next + 1) % kJmtCacheSize;
+            m_horizons[slot] = T;
+            m_inverses[slot] = inv;
+        }
+        return m_inverses[slot];
+    }
+
+    std::vector<double> m_horizons;
+    std::vector<Eigen::Matrix3d> m_inverses;
+    size_t m_next;
+};
+
+#endif /* JMT_H */
@@ -0,0 +1,143 @@
+#ifndef LANE_GRAPH_H
+#define LANE_GRAPH_H
+
+#include <cstdint>
+#include <vector>
+#include "binary_io.h"
+
+// Lanes the map has when its source carries no lane information
+const int kDefaultLanes = 3;
+const double kDefaultLaneWidth = 4.0;
+
+// What happens to a lane at the end of its section
+enum LaneKind : uint8_t {
+    kLaneThrough = 0,   // continues in its successor
+    kLaneMerge = 1,     // ends, traffic merges into the left neighbour
+    kLaneExit = 2       // leaves the road
+};
+
+// Lane layout of the road, loaded with the map.
+// The road is split into sections of constant layout, every waypoint segment belongs to
+// exactly one section. Lanes are numbered within their section from the centre line
+// outwards (lane 0 is the leftmost one) and get a graph wide id for the connectivity.
+// All arrays are flat and indexed by section or lane id.
+class LaneGraph {
+public:
+    // per section: id of its lane 0 and number of lanes
+    std::vector<int> section_first_lane;
+    std::vector<int> section_lanes;
+    // section of every waypoint segment
+    std::vector<int> segment_section;
+
+    // per lane id: d of its left boundary, its width and its neighbours (-1 if none)
+    std::vector<double> lane_inner_d;
+    std::vector<double> lane_width;
+    std::vector<int> lane_left;
+    std::vector<int> lane_right;
+    std::vector<int> lane_successor;
+    std::vector<uint8_t> lane_kind;
+
+    bool empty() const { return section_lanes.empty(); }
+
+    // One section over the whole closed loop with lanes of equal width
+    void build_uniform(size_t segments, int lanes, double width) {
+        section_first_lane.assign(1, 0);
+        section_lanes.assign(1, lanes);
+        segment_section.assign(segments, 0);
+        lane_inner_d.resize(lanes);
+        lane_width.assign(lanes, width);
+        lane_left.resize(lanes);
+        lane_right.resize(lanes);
+        lane_successor.resize(lanes);
+        lane_kind.assign(lanes, kLaneThrough);
+        for (int lane = 0; lane < lanes; lane++) {
+            lane_inner_d[lane] = lane * width;
+            lane_left[lane] = lane > 0 ? lane - 1 : -1;
+            lane_right[lane] = lane + 1 < lanes ? lane + 1 : -1;
+            // the loop closes onto itself
+            lane_successor[lane] = lane;
+        }
+    }
+
+    int lanes(int section) const { return section_lanes[section]; }
+
+    // Lane of the section containing d, -1 if d is off the road
+    int lane_at(int section, double d) const {
+        int first = section_first_lane[section];
+        for (int lane = 0; lane < section_lanes[section]; lane++) {
+            double inner = lane_inner_d[first + lane];
+            if (d >= inner && d < inner + lane_width[first + lane]) {
+                return lane;
+            }
+        }
+        return -1;
+    }
+
+    // d of the centre of a lane of the section
+    double center(int section, int lane) const {
+        int id = section_first_lane[section] + lane;
+        return lane_inner_d[id] + 0.5 * lane_width[id];
+    }
+
+    // Neighbouring lanes within the section, -1 if there is none
+    int left(int section, int lane) const {
+        int id = lane_left[section_first_lane[section] + lane];
+        return id < 0 ? -1 : id - section_first_lane[section];
+    }
+
+    int right(int section, int lane) const {
+        int id = lane_right[section_first_lane[section] + lane];
+        return id < 0 ? -1 : id - section_first_lane[section];
+    }
+
+    void save(BinaryWriter &out) const {
+        out.array(section_first_lane);
+        out.array(section_lanes);
+        out.array(segment_section);
+        out.array(lane_inner_d);
+        out.array(lane_width);
+        out.array(lane_left);
+        out.array(lane_right);
+        out.array(lane_successor);
+        out.array(lane_kind);
+    }
+
+    bool load(BinaryReader &in) {
+        in.array(section_first_lane);
+        in.array(section_lanes);
+        in.array(segment_section);
+        in.array(lane_inner_d);
+        in.array(lane_width);
+        in.array(lane_left);
+        in.array(lane_right);
+        in.array(lane_successor);
+        in.array(lane_kind);
+        size_t n = lane_inner_d.size();
+        if (!in.ok() || section_first_lane.size() != section_lanes.size() || lane_width.size() != n ||
+            lane_left.size() != n || lane_right.size() != n || lane_successor.size() != n || lane_kind.size() != n) {
+            return false;
+        }
+        for (size_t k = 0; k < section_lanes.size(); k++) {
+            int first = section_first_lane[k];
+            if (first < 0 || first > (int) n || section_lanes[k] <= 0 || section_lanes[k] > (int) n - first) {
+                return false;
+            }
+            // neighbours stay within the section, successors may be any lane
+            for (int id = first; id < first + section_lanes[k]; id++) {
+                if ((lane_left[id] != -1 && (lane_left[id] < first || lane_left[id] >= first + section_lanes[k])) ||
+                    (lane_right[id] != -1 && (lane_right[id] < first || lane_right[id] >= first + section_lanes[k])) ||
+                    lane_successor[id] < -1 || lane_successor[id] >= (int) n) {
+                    return false;
+                }
+            }
+        }
+        for (size_t k = 0; k < segment_section.size(); k++) {
+            if (segment_section[k] < 0 || segment_section[k] >= (int) section_lanes.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif /* LANE_GRAPH_H */
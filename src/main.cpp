@@ -8,7 +8,14 @@
 #include "Eigen-3.3/Eigen/Core"
 #include "Eigen-3.3/Eigen/QR"
 #include "json.hpp"
+#include "map.h"
+#include "map_file.h"
+#include "map_store.h"
+#ifdef EMBEDDED_MAP
+#include "map_embedded.h"
+#endif
 #include "spline.h"
+#include "vehicle_table.h"
 
 using namespace std;
 
@@ -16,8 +23,6 @@ using namespace std;
 using json = nlohmann::json;
 
 // For converting back and forth between radians and degrees.
-constexpr double pi() { return M_PI; }
-
 double deg2rad(double x) { return x * pi() / 180; }
 
 double rad2deg(double x) { return x * 180 / pi(); }
@@ -37,140 +42,18 @@ string hasData(string s) {
     return "";
 }
 
-double distance(double x1, double y1, double x2, double y2) {
-    return sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-}
-
-
-int ClosestWaypoint(double x, double y, const vector<double> &maps_x, const vector<double> &maps_y) {
-
-    double closestLen = 100000; //large number
-    int closestWaypoint = 0;
-
-    for (int i = 0; i < maps_x.size(); i++) {
-        double map_x = maps_x[i];
-        double map_y = maps_y[i];
-        double dist = distance(x, y, map_x, map_y);
-        if (dist < closestLen) {
-            closestLen = dist;
-            closestWaypoint = i;
-        }
-
-    }
-
-    return closestWaypoint;
-
-}
-
-int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x, const vector<double> &maps_y) {
-
-    int closestWaypoint = ClosestWaypoint(x, y, maps_x, maps_y);
-
-    double map_x = maps_x[closestWaypoint];
-    double map_y = maps_y[closestWaypoint];
-
-    double heading = atan2((map_y - y), (map_x - x));
-
-    double angle = fabs(theta - heading);
-    angle = min(2 * pi() - angle, angle);
-
-    if (angle > pi() / 4) {
-        closestWaypoint++;
-        if (closestWaypoint == maps_x.size()) {
-            closestWaypoint = 0;
-        }
-    }
-
-    return closestWaypoint;
-}
-
-
-// Transform from Cartesian x,y coordinates to Frenet s,d coordinates
-vector<double> getFrenet(double x, double y, double theta, const vector<double> &maps_x, const vector<double> &maps_y) {
-    int next_wp = NextWaypoint(x, y, theta, maps_x, maps_y);
-
-    int prev_wp;
-    prev_wp = next_wp - 1;
-    if (next_wp == 0) {
-        prev_wp = maps_x.size() - 1;
-    }
-
-    double n_x = maps_x[next_wp] - maps_x[prev_wp];
-    double n_y = maps_y[next_wp] - maps_y[prev_wp];
-    double x_x = x - maps_x[prev_wp];
-    double x_y = y - maps_y[prev_wp];
-
-    // find the projection of x onto n
-    double proj_norm = (x_x * n_x + x_y * n_y) / (n_x * n_x + n_y * n_y);
-    double proj_x = proj_norm * n_x;
-    double proj_y = proj_norm * n_y;
-
-    double frenet_d = distance(x_x, x_y, proj_x, proj_y);
-
-    //see if d value is positive or negative by comparing it to a center point
-
-    double center_x = 1000 - maps_x[prev_wp];
-    double center_y = 2000 - maps_y[prev_wp];
-    double centerToPos = distance(center_x, center_y, x_x, x_y);
-    double centerToRef = distance(center_x, center_y, proj_x, proj_y);
-
-    if (centerToPos <= centerToRef) {
-        frenet_d *= -1;
-    }
-
-    // calculate s value
-    double frenet_s = 0;
-    for (int i = 0; i < prev_wp; i++) {
-        frenet_s += distance(maps_x[i], maps_y[i], maps_x[i + 1], maps_y[i + 1]);
-    }
-
-    frenet_s += distance(0, 0, proj_x, proj_y);
-
-    return {frenet_s, frenet_d};
-
-}
-
-// Transform from Frenet s,d coordinates to Cartesian x,y
-vector<double>
-getXY(double s, double d, const vector<double> &maps_s, const vector<double> &maps_x, const vector<double> &maps_y) {
-    int prev_wp = -1;
-
-    while (s > maps_s[prev_wp + 1] && (prev_wp < (int) (maps_s.size() - 1))) {
-        prev_wp++;
-    }
-
-    int wp2 = (prev_wp + 1) % maps_x.size();
-
-    double heading = atan2((maps_y[wp2] - maps_y[prev_wp]), (maps_x[wp2] - maps_x[prev_wp]));
-    // the x,y,s along the segment
-    double seg_s = (s - maps_s[prev_wp]);
-
-    double seg_x = maps_x[prev_wp] + seg_s * cos(heading);
-    double seg_y = maps_y[prev_wp] + seg_s * sin(heading);
-
-    double perp_heading = heading - pi() / 2;
-
-    double x = seg_x + d * cos(perp_heading);
-    double y = seg_y + d * sin(perp_heading);
-
-    return {x, y};
-
-}
-
-bool Check_Lane(double car_s, double car_v, int lane, int prev_size, const vector<vector<double>> &sensor_fusion) {
+bool Check_Lane(double car_s, double car_v, int lane, int prev_size, const VehicleTable &vehicles) {
     bool ret_val = true;
     // check all vehicles on the right side of the road
-    for (auto &&vehicle : sensor_fusion) {
+    for (int id : vehicles.active()) {
+        const VehicleState &vehicle = vehicles[id];
         //are they in my lane?
-        double other_vehicles_d = vehicle[6];
-        if (other_vehicles_d > (2 + 4 * lane - 2) && other_vehicles_d < (2 + 4 * lane + 2)) {
+        if (vehicle.lane == lane) {
 
-            // Calculate the speed of the other vehicle
-            double vx = vehicle[3];
-            double vy = vehicle[4];
-            double check_speed = sqrt(vx * vx + vy * vy);
+            // speed of the other vehicle
+            double check_speed = vehicle.speed;
 
-            double other_vehicles_current_s = vehicle[5];
+            double other_vehicles_current_s = vehicle.s;
 
             // calculate the s for both vehicles for the near future
             double other_vehicles_future_s = other_vehicles_future_s + ((double) prev_size * 0.02 * check_speed);
@@ -188,42 +71,24 @@ bool Check_Lane(double car_s, double car_v, int lane, int prev_size, const vecto
     return ret_val;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     uWS::Hub h;
 
-    // Load up map values for waypoint's x,y,s and d normalized normal vectors
-    vector<double> map_waypoints_x;
-    vector<double> map_waypoints_y;
-    vector<double> map_waypoints_s;
-    vector<double> map_waypoints_dx;
-    vector<double> map_waypoints_dy;
-
-    // Waypoint map to read from
-    string map_file_ = "../data/highway_map.csv";
-    // The max s value before wrapping around the track back to 0
-    double max_s = 6945.554;
-
-    ifstream in_map_(map_file_.c_str(), ifstream::in);
-
-    string line;
-    while (getline(in_map_, line)) {
-        istringstream iss(line);
-        double x;
-        double y;
-        float s;
-        float d_x;
-        float d_y;
-        iss >> x;
-        iss >> y;
-        iss >> s;
-        iss >> d_x;
-        iss >> d_y;
-        map_waypoints_x.push_back(x);
-        map_waypoints_y.push_back(y);
-        map_waypoints_s.push_back(s);
-        map_waypoints_dx.push_back(d_x);
-        map_waypoints_dy.push_back(d_y);
+#ifdef EMBEDDED_MAP
+    // Waypoint map compiled into the binary, it never changes
+    MapStore map_store(std::make_shared<Map>(load_embedded_map()));
+#else
+    // Waypoint map to read from, either the csv or a map compiled by map_convert
+    string map_file = argc > 1 ? argv[1] : "../data/highway_map.csv";
+    std::shared_ptr<Map> initial_map = std::make_shared<Map>();
+    if (!load_map_auto(map_file, *initial_map)) {
+        std::cerr << "Failed to load map " << map_file << std::endl;
+        return -1;
     }
+    // reload the map in the background whenever the file changes or /reload_map is requested
+    MapStore map_store(initial_map);
+    map_store.watch(map_file);
+#endif
 
 
     // start in line 1
@@ -233,9 +98,11 @@ int main() {
     // Have a reference velocity to target
     double ref_vel = 0; //mph set to 0 to start at velocity 0
 
+    // other vehicles by sensor fusion id, kept across frames
+    VehicleTable vehicles;
 
     h.onMessage(
-            [&ref_vel, &my_lane, &map_waypoints_x, &map_waypoints_y, &map_waypoints_s, &map_waypoints_dx, &map_waypoints_dy](
+            [&ref_vel, &my_lane, &vehicles, &map_store](
                     uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
                     uWS::OpCode opCode) {
                 // "42" at the start of the message means there's a websocket message event.
@@ -255,6 +122,10 @@ int main() {
                         if (event == "telemetry") {
                             // j[1] is the data JSON object
 
+                            // the whole frame runs on one map snapshot, even if a reload is published meanwhile
+                            std::shared_ptr<const Map> map_snapshot = map_store.get();
+                            const Map &map = *map_snapshot;
+
                             // Main car's localization Data
                             double car_x = j[1]["x"];
                             double car_y = j[1]["y"];
@@ -287,59 +158,37 @@ int main() {
                             bool change_lane = false;
 
 
-                            for (auto &&vehicle : sensor_fusion) {
+                            vehicles.update(sensor_fusion, map);
+
+                            for (int id : vehicles.active()) {
+                                const VehicleState &vehicle = vehicles[id];
                                 //are they in my lane?
-                                double other_vehicles_d = vehicle[6];
-                                if (other_vehicles_d > (2 + 4 * my_lane - 2) &&
-                                    other_vehicles_d < (2 + 4 * my_lane + 2)) {
+                                if (vehicle.lane == my_lane) {
 
-                                    // Calculate the speed of the other vehicle
-                                    double vx = vehicle[3];
-                                    double vy = vehicle[4];
-                                    double check_speed = sqrt(vx * vx + vy * vy);
+                                    // speed of the other vehicle
+                                    double check_speed = vehicle.speed;
 
-                                    double other_vehicles_current_s = vehicle[5];
+                                    double other_vehicles_current_s = vehicle.s;
                                     double other_vehicles_future_s =
                                             other_vehicles_current_s + ((double) prev_size * 0.02 * check_speed);
                                     if ((other_vehicles_current_s > car_s) &&
                                         ((other_vehicles_future_s - car_s) < 40)) {
                                         // change the lane asap!
                                         too_close = true;
-                                        switch (my_lane) {
-                                            case 0:
-                                                // when on the left lane, go to the middle lane
-                                                if (Check_Lane(car_s, car_speed, 1, prev_size, sensor_fusion)) {
-                                                    my_lane = 1;
-                                                    change_lane = true;
-                                                }
-                                                // else do nothing and be a sad slow panda
-                                                break;
-
-                                            case 1:
-                                                // when on the middle lane, go to the left lane
-                                                if (Check_Lane(car_s, car_speed, 0, prev_size, sensor_fusion)) {
-                                                    my_lane = 0;
-                                                    change_lane = true;
-                                                } else if (Check_Lane(car_s, car_speed, 2, prev_size, sensor_fusion)) {
-                                                    // when the left lane is occupied, try the right lane
-                                                    my_lane = 2;
-                                                    change_lane = true;
-
-                                                }
-                                                // else do nothing and be a sad slow panda
-                                                break;
-                                            case 2:
-                                                // when on the right lane, go to the middle lane
-                                                if (Check_Lane(car_s, car_speed, 1, prev_size, sensor_fusion)) {
-                                                    my_lane = 1;
-                                                    change_lane = true;
-                                                }
-                                                // else do nothing and be a sad slow panda
-                                                break;
-                                            default:
-                                                // where are you even driving?!
-                                                break;
+                                        // try the left lane first, when it is occupied (or there is none) the right one
+                                        int section = map.section_at(car_s);
+                                        int left_lane = map.lanes.left(section, my_lane);
+                                        int right_lane = map.lanes.right(section, my_lane);
+                                        if (left_lane >= 0 &&
+                                            Check_Lane(car_s, car_speed, left_lane, prev_size, vehicles)) {
+                                            my_lane = left_lane;
+                                            change_lane = true;
+                                        } else if (right_lane >= 0 &&
+                                                   Check_Lane(car_s, car_speed, right_lane, prev_size, vehicles)) {
+                                            my_lane = right_lane;
+                                            change_lane = true;
                                         }
+                                        // else do nothing and be a sad slow panda
 
                                     }
 
@@ -381,6 +230,10 @@ int main() {
 
                                 ptsx.push_back(ref_x_prev);
                                 ptsy.push_back(ref_y_prev);
+                            } else {
+                                // no usable previous path, use a point just behind the car so the spline always has 5 points
+                                ptsx.push_back(ref_x - cos(ref_yaw));
+                                ptsy.push_back(ref_y - sin(ref_yaw));
                             }
 
 
@@ -389,12 +242,9 @@ int main() {
                             ptsy.push_back(ref_y);
 
                             // generate future waypoints
-                            vector<double> next_waypoint0 = getXY(car_s + 30, (2 + my_lane * 4), map_waypoints_s,
-                                                                  map_waypoints_x, map_waypoints_y);
-                            vector<double> next_waypoint1 = getXY(car_s + 60, (2 + my_lane * 4), map_waypoints_s,
-                                                                  map_waypoints_x, map_waypoints_y);
-                            vector<double> next_waypoint2 = getXY(car_s + 90, (2 + my_lane * 4), map_waypoints_s,
-                                                                  map_waypoints_x, map_waypoints_y);
+                            vector<double> next_waypoint0 = getXY(car_s + 30, LaneCenter(car_s + 30, my_lane, map), map);
+                            vector<double> next_waypoint1 = getXY(car_s + 60, LaneCenter(car_s + 60, my_lane, map), map);
+                            vector<double> next_waypoint2 = getXY(car_s + 90, LaneCenter(car_s + 90, my_lane, map), map);
 
                             ptsx.push_back(next_waypoint0[0]);
                             ptsx.push_back(next_waypoint1[0]);
@@ -404,23 +254,10 @@ int main() {
                             ptsy.push_back(next_waypoint1[1]);
                             ptsy.push_back(next_waypoint2[1]);
 
-                            //Shift the points to car's frame of reference
-
-                            for (int i = 0; i < ptsx.size(); i++) {
-                                // shift car reference angle to 0 degrees
-                                double shift_x = ptsx[i] - ref_x;
-                                double shift_y = ptsy[i] - ref_y;
-
-                                ptsx[i] = (shift_x * cos(0 - ref_yaw) - shift_y * sin(0 - ref_yaw));
-                                ptsy[i] = (shift_x * sin(0 - ref_yaw) + shift_y * cos(0 - ref_yaw));
-
-                            }
-
-                            //create a spline
-                            tk::spline s;
-
-                            //set (x,y) points to the spline
-                            s.set_points(ptsx, ptsy);
+                            //create a parametric spline through the 5 points above, it works in map coordinates
+                            //so there is no need to turn them into the car's frame first
+                            tk::fixed_spline2d<5> s;
+                            s.set_points(ptsx.data(), ptsy.data());
 
 
                             vector<double> next_x_vals;
@@ -433,35 +270,20 @@ int main() {
                             }
 
 
-                            //calculate how to break up spline points so that we travel at our desired reference velocity
-                            double target_x = 30.0;
-                            double target_y = s(target_x);
-                            double target_dist = sqrt((target_x) * (target_x) + (target_y) * (target_y));
-
-                            double x_add_on = 0;
-
                             //Fill up the rest of our path planner after filling it with previous points, here we will always output 50 points
-                            for (int i = 0; i < 50 - previous_path_x.size(); i++) {
-
-                                double N = (target_dist / (.02 * ref_vel / 2.24));
-                                double x_point = x_add_on + (target_x) / N;
-                                double y_point = s(x_point);
-
-                                x_add_on = x_point;
+                            //spaced along the spline so that we travel at our desired reference velocity
+                            int new_points = std::max(0, 50 - (int) previous_path_x.size());
+                            double dist_inc = .02 * ref_vel / 2.24;
+                            vector<double> t_points(new_points);
+                            vector<double> x_points(new_points);
+                            vector<double> y_points(new_points);
+                            // the new points continue from the reference point, the second one of the spline
+                            s.sample_arc_length(s.knot(1), dist_inc, new_points, t_points.data());
+                            // one pass over the spline segments for all points
+                            s.evaluate(t_points.data(), new_points, x_points.data(), y_points.data());
 
-                                double x_ref = x_point;
-                                double y_ref = y_point;
-
-                                //rotate back to normal after rotation it earlier
-                                x_point = (x_ref * cos(ref_yaw) - y_ref * sin(ref_yaw));
-                                y_point = (x_ref * sin(ref_yaw) + y_ref * cos(ref_yaw));
-
-                                x_point += ref_x;
-                                y_point += ref_y;
-
-                                next_x_vals.push_back(x_point);
-                                next_y_vals.push_back(y_point);
-                            }
+                            next_x_vals.insert(next_x_vals.end(), x_points.begin(), x_points.end());
+                            next_y_vals.insert(next_y_vals.end(), y_points.begin(), y_points.end());
 
 
                             msgJson["next_x"] = next_x_vals;
@@ -484,11 +306,18 @@ int main() {
     // We don't need this since we're not using HTTP but if it's removed the
     // program
     // doesn't compile :-(
-    h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
-                       size_t, size_t) {
+    h.onHttpRequest([&map_store](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
+                                 size_t, size_t) {
         const std::string s = "<h1>Hello world!</h1>";
+        const std::string url(req.getUrl().value, req.getUrl().valueLength);
         if (req.getUrl().valueLength == 1) {
             res->end(s.data(), s.length());
+#ifndef EMBEDDED_MAP
+        } else if (url == "/reload_map") {
+            map_store.reload();
+            const std::string reload = "<h1>Reloading map</h1>";
+            res->end(reload.data(), reload.length());
+#endif
         } else {
             // i guess this should be done more gracefully?
             res->end(nullptr, 0);
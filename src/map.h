@@ -0,0 +1,319 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <algorithm>
+#include "centerline.h"
+#include "lane_graph.h"
+#include "waypoint_index.h"
+
+// Waypoint map of the track together with the tables derived from it at load time.
+struct Map {
+    // waypoint's x,y,s and d normalized normal vectors
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> s;
+    std::vector<double> dx;
+    std::vector<double> dy;
+
+    // cumulative chord length from waypoint 0 up to waypoint i,
+    // so that the s of a point on segment i is cum_s[i] plus its offset on the segment
+    std::vector<double> cum_s;
+
+    // geometry of segment i from waypoint i to waypoint (i + 1) % n:
+    // unit tangent, unit normal pointing to the right (positive d) and length
+    std::vector<double> seg_tx;
+    std::vector<double> seg_ty;
+    std::vector<double> seg_nx;
+    std::vector<double> seg_ny;
+    std::vector<double> seg_len;
+
+    // spatial index for nearest waypoint / segment queries
+    WaypointIndex index;
+
+    // The max s value before wrapping around the track back to 0,
+    // the s of the last waypoint plus the closing segment back to the first one
+    double max_s = 0;
+
+    // s_bucket[k] is the last waypoint with s <= k * s_bucket_len, so getXY finds
+    // the segment of an s by indexing a bucket and stepping over at most a few waypoints
+    std::vector<int> s_bucket;
+    double s_bucket_len = 1;
+
+    // dense smoothed centerline used by getXY, sampled every centerline_ds meters
+    Centerline centerline;
+    double centerline_ds = kDefaultCenterlineDs;
+
+    // lane layout, the csv has none so every segment gets kDefaultLanes lanes
+    LaneGraph lanes;
+
+    size_t size() const { return x.size(); }
+
+    // Builds the derived tables, has to be called after the waypoints changed.
+    void build() {
+        build_lookup();
+        centerline.build(x, y, s, dx, dy, max_s, centerline_ds);
+    }
+
+    // Builds the cheap lookup tables, everything but the centerline
+    void build_lookup() {
+        size_t n = size();
+        seg_tx.resize(n);
+        seg_ty.resize(n);
+        seg_nx.resize(n);
+        seg_ny.resize(n);
+        seg_len.resize(n);
+        cum_s.assign(n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+            size_t j = (i + 1) % n;
+            double seg_x = x[j] - x[i];
+            double seg_y = y[j] - y[i];
+            double len = sqrt(seg_x * seg_x + seg_y * seg_y);
+            seg_len[i] = len;
+            seg_tx[i] = len > 0 ? seg_x / len : 1;
+            seg_ty[i] = len > 0 ? seg_y / len : 0;
+            seg_nx[i] = seg_ty[i];
+            seg_ny[i] = -seg_tx[i];
+            if (j > 0) {
+                cum_s[j] = cum_s[i] + len;
+            }
+        }
+        index.build(x, y);
+
+        if (n == 0) {
+            max_s = 0;
+            s_bucket.clear();
+            return;
+        }
+        max_s = s[n - 1] + seg_len[n - 1];
+
+        // buckets half as long as an average segment, so a bucket spans few waypoints
+        size_t buckets = 2 * n;
+        s_bucket_len = max_s / buckets;
+        s_bucket.assign(buckets + 1, 0);
+        int wp = 0;
+        for (size_t k = 0; k < s_bucket.size(); k++) {
+            double bucket_s = k * s_bucket_len;
+            while (wp + 1 < (int) n && s[wp + 1] <= bucket_s) {
+                wp++;
+            }
+            s_bucket[k] = wp;
+        }
+
+        lanes.build_uniform(n, kDefaultLanes, kDefaultLaneWidth);
+    }
+
+    // Normalizes s into [0, max_s), so points past the lap seam map onto the start of the track
+    double wrap_s(double s_value) const {
+        s_value = fmod(s_value, max_s);
+        if (s_value < 0) {
+            s_value += max_s;
+        }
+        return s_value;
+    }
+
+    // Lane section at s
+    int section_at(double s_value) const {
+        return lanes.segment_section[segment_at(wrap_s(s_value))];
+    }
+
+    // Waypoint at the start of the segment containing the wrapped s value
+    int segment_at(double s_value) const {
+        int n = size();
+        size_t k = std::min((size_t) (s_value / s_bucket_len), s_bucket.size() - 1);
+        int wp = s_bucket[k];
+        while (wp + 1 < n && s[wp + 1] <= s_value) {
+            wp++;
+        }
+        return wp;
+    }
+};
+
+// Reads the waypoint map from a whitespace separated csv file.
+// A last row repeating waypoint 0 is dropped, the loop closes by itself.
+// Returns an empty map if a row does not parse or s does not strictly increase,
+// e.g. while the file is still being written.
+inline Map load_map(const std::string &map_file, double centerline_ds = kDefaultCenterlineDs) {
+    Map map;
+    map.centerline_ds = centerline_ds;
+
+    std::ifstream in_map_(map_file.c_str(), std::ifstream::in);
+
+    std::string line;
+    while (getline(in_map_, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::istringstream iss(line);
+        double x;
+        double y;
+        float s;
+        float d_x;
+        float d_y;
+        if (!(iss >> x >> y >> s >> d_x >> d_y) || (!map.s.empty() && s <= map.s.back())) {
+            return Map();
+        }
+        map.x.push_back(x);
+        map.y.push_back(y);
+        map.s.push_back(s);
+        map.dx.push_back(d_x);
+        map.dy.push_back(d_y);
+    }
+    // a file that closes the loop by repeating waypoint 0 would leave a zero length
+    // closing segment, so max_s would not lie past the last waypoint
+    while (map.size() > 1 && map.x.back() == map.x[0] && map.y.back() == map.y[0]) {
+        map.x.pop_back();
+        map.y.pop_back();
+        map.s.pop_back();
+        map.dx.pop_back();
+        map.dy.pop_back();
+    }
+
+    map.build();
+    return map;
+}
+
+constexpr double pi() { return M_PI; }
+
+inline double distance(double x1, double y1, double x2, double y2) {
+    return sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+}
+
+
+inline int ClosestWaypoint(double x, double y, const Map &map) {
+    return map.index.closest_waypoint(x, y);
+}
+
+// Local walk along the track used by the cursor lookups, gives up after this many steps
+const int kCursorMaxSteps = 8;
+
+// Remembers the waypoint found for a tracked entity (ego or a sensor fusion vehicle)
+// in the previous frame, so the next lookup can start from there.
+struct MapCursor {
+    int waypoint = -1;
+    // Frenet s of the last getFrenet, negative while unknown
+    double s = -1;
+};
+
+// Squared last Newton step above which a warm started projection counts as failed
+const double kProjectTolerance = 1e-4;
+
+// Same as ClosestWaypoint, but walks forwards or backwards from the waypoint found last time.
+// Falls back to the global search when the cursor is unset or the walk does not settle.
+inline int ClosestWaypoint(double x, double y, const Map &map, MapCursor &cursor) {
+    int n = map.size();
+    int wp = cursor.waypoint;
+    if (wp >= 0 && wp < n) {
+        double dist2 = (x - map.x[wp]) * (x - map.x[wp]) + (y - map.y[wp]) * (y - map.y[wp]);
+        for (int step = 0; step < kCursorMaxSteps; step++) {
+            int fwd = (wp + 1) % n;
+            int bwd = (wp + n - 1) % n;
+            double fwd2 = (x - map.x[fwd]) * (x - map.x[fwd]) + (y - map.y[fwd]) * (y - map.y[fwd]);
+            double bwd2 = (x - map.x[bwd]) * (x - map.x[bwd]) + (y - map.y[bwd]) * (y - map.y[bwd]);
+            if (fwd2 < dist2 && fwd2 <= bwd2) {
+                wp = fwd;
+                dist2 = fwd2;
+            } else if (bwd2 < dist2) {
+                wp = bwd;
+                dist2 = bwd2;
+            } else {
+                // local minimum reached
+                cursor.waypoint = wp;
+                return wp;
+            }
+        }
+    }
+    cursor.waypoint = ClosestWaypoint(x, y, map);
+    return cursor.waypoint;
+}
+
+// Steps past the closest waypoint if it lies behind a car at x,y heading theta
+inline int NextWaypointFrom(int closestWaypoint, double x, double y, double theta, const Map &map) {
+
+    double map_x = map.x[closestWaypoint];
+    double map_y = map.y[closestWaypoint];
+
+    double heading = atan2((map_y - y), (map_x - x));
+
+    double angle = fabs(theta - heading);
+    angle = std::min(2 * pi() - angle, angle);
+
+    if (angle > pi() / 4) {
+        closestWaypoint++;
+        if (closestWaypoint == (int) map.size()) {
+            closestWaypoint = 0;
+        }
+    }
+
+    return closestWaypoint;
+}
+
+inline int NextWaypoint(double x, double y, double theta, const Map &map) {
+    return NextWaypointFrom(ClosestWaypoint(x, y, map), x, y, theta, map);
+}
+
+inline int NextWaypoint(double x, double y, double theta, const Map &map, MapCursor &cursor) {
+    return NextWaypointFrom(ClosestWaypoint(x, y, map, cursor), x, y, theta, map);
+}
+
+
+// Transform from Cartesian x,y coordinates to Frenet s,d coordinates, relative to the segment ending in next_wp
+inline void getFrenetFrom(int next_wp, double x, double y, const Map &map, double &frenet_s, double &frenet_d) {
+    int prev_wp;
+    prev_wp = next_wp - 1;
+    if (next_wp == 0) {
+        prev_wp = map.size() - 1;
+    }
+
+    double x_x = x - map.x[prev_wp];
+    double x_y = y - map.y[prev_wp];
+
+    // project onto the segment's tangent and normal, d is positive on the right side
+    frenet_s = map.cum_s[prev_wp] + x_x * map.seg_tx[prev_wp] + x_y * map.seg_ty[prev_wp];
+    frenet_d = x_x * map.seg_nx[prev_wp] + x_y * map.seg_ny[prev_wp];
+}
+
+// Transform from Cartesian x,y coordinates to Frenet s,d coordinates.
+// The projection onto the nearest chord seeds a Newton projection onto the smoothed centerline,
+// so the result is the exact inverse of getXY.
+inline std::vector<double> getFrenet(double x, double y, double theta, const Map &map) {
+    double frenet_s, frenet_d;
+    getFrenetFrom(NextWaypoint(x, y, theta, map), x, y, map, frenet_s, frenet_d);
+    map.centerline.project(x, y, frenet_s, frenet_d);
+    return {frenet_s, frenet_d};
+}
+
+// Same as getFrenet, warm started from the s the cursor of the tracked entity found last frame
+inline std::vector<double> getFrenet(double x, double y, double theta, const Map &map, MapCursor &cursor) {
+    double frenet_s = cursor.s;
+    double frenet_d;
+    if (frenet_s < 0 || map.centerline.project(x, y, frenet_s, frenet_d) > kProjectTolerance) {
+        getFrenetFrom(NextWaypoint(x, y, theta, map, cursor), x, y, map, frenet_s, frenet_d);
+        map.centerline.project(x, y, frenet_s, frenet_d);
+    }
+    cursor.s = frenet_s;
+    return {frenet_s, frenet_d};
+}
+
+// Lane containing the Frenet point s,d, -1 when it is off the road
+inline int LaneAt(double s, double d, const Map &map) {
+    return map.lanes.lane_at(map.section_at(s), d);
+}
+
+// d of the centre of a lane at s
+inline double LaneCenter(double s, int lane, const Map &map) {
+    return map.lanes.center(map.section_at(s), lane);
+}
+
+// Transform from Frenet s,d coordinates to Cartesian x,y on the smoothed centerline
+inline std::vector<double> getXY(double s, double d, const Map &map) {
+    double x, y;
+    map.centerline.to_xy(map.wrap_s(s), d, x, y);
+    return {x, y};
+}
+
+#endif /* MAP_H */
@@ -0,0 +1,190 @@
+#ifndef MAP_BATCH_H
+#define MAP_BATCH_H
+
+#include <cstddef>
+#include <math.h>
+#include "map.h"
+
+// Batch Frenet/Cartesian conversions over structure-of-arrays inputs.
+// Nothing is allocated, the caller owns all input and output arrays.
+// On x86 the AVX2 kernel is picked at runtime when the cpu supports it,
+// everything else runs the scalar loop.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAP_BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace batch_detail {
+
+inline void to_xy_scalar(const Map &map, const double *s, const double *d, size_t n, double *x, double *y) {
+    const Centerline &c = map.centerline;
+    double inv_max_s = 1.0 / map.max_s;
+    for (size_t i = 0; i < n; i++) {
+        double wrapped = s[i] - map.max_s * floor(s[i] * inv_max_s);
+        c.to_xy(wrapped, d[i], x[i], y[i]);
+    }
+}
+
+#ifdef MAP_BATCH_X86
+// masked form of the gather, the unmasked intrinsic trips -Wmaybe-uninitialized in gcc's headers
+__attribute__((target("avx2")))
+inline __m256d gather(const double *base, __m128i idx) {
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, idx, all, 8);
+}
+
+// Four points per iteration, the centerline samples are fetched with gathers
+__attribute__((target("avx2")))
+inline void to_xy_avx2(const Map &map, const double *s, const double *d, size_t n, double *x, double *y) {
+    const Centerline &c = map.centerline;
+    const __m256d max_s = _mm256_set1_pd(map.max_s);
+    const __m256d inv_max_s = _mm256_set1_pd(1.0 / map.max_s);
+    const __m256d inv_ds = _mm256_set1_pd(1.0 / c.ds());
+    const __m128i first = _mm_setzero_si128();
+    const __m128i last = _mm_set1_epi32((int) c.x.size() - 2);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d s_v = _mm256_loadu_pd(s + i);
+        __m256d d_v = _mm256_loadu_pd(d + i);
+
+        // wrap s into [0, max_s) and split it into sample index and fraction
+        s_v = _mm256_sub_pd(s_v, _mm256_mul_pd(max_s, _mm256_floor_pd(_mm256_mul_pd(s_v, inv_max_s))));
+        __m256d pos = _mm256_mul_pd(s_v, inv_ds);
+        __m128i idx = _mm256_cvttpd_epi32(pos);
+        idx = _mm_max_epi32(_mm_min_epi32(idx, last), first);
+        __m256d t = _mm256_sub_pd(pos, _mm256_cvtepi32_pd(idx));
+
+        __m256d x0 = gather(c.x.data(), idx);
+        __m256d x1 = gather(c.x.data() + 1, idx);
+        __m256d y0 = gather(c.y.data(), idx);
+        __m256d y1 = gather(c.y.data() + 1, idx);
+        __m256d dx0 = gather(c.dx.data(), idx);
+        __m256d dx1 = gather(c.dx.data() + 1, idx);
+        __m256d dy0 = gather(c.dy.data(), idx);
+        __m256d dy1 = gather(c.dy.data() + 1, idx);
+
+        __m256d c_x = _mm256_add_pd(x0, _mm256_mul_pd(t, _mm256_sub_pd(x1, x0)));
+        __m256d c_y = _mm256_add_pd(y0, _mm256_mul_pd(t, _mm256_sub_pd(y1, y0)));
+        __m256d n_x = _mm256_add_pd(dx0, _mm256_mul_pd(t, _mm256_sub_pd(dx1, dx0)));
+        __m256d n_y = _mm256_add_pd(dy0, _mm256_mul_pd(t, _mm256_sub_pd(dy1, dy0)));
+
+        _mm256_storeu_pd(x + i, _mm256_add_pd(c_x, _mm256_mul_pd(d_v, n_x)));
+        _mm256_storeu_pd(y + i, _mm256_add_pd(c_y, _mm256_mul_pd(d_v, n_y)));
+    }
+    to_xy_scalar(map, s + i, d + i, n - i, x + i, y + i);
+}
+
+// Four lane version of Centerline::project, with the same fixed number of Newton steps
+__attribute__((target("avx2")))
+inline void project_avx2(const Map &map, const double *x, const double *y, size_t n, double *s, double *d) {
+    const Centerline &c = map.centerline;
+    const __m256d length = _mm256_set1_pd(c.length());
+    const __m256d inv_length = _mm256_set1_pd(1.0 / c.length());
+    const __m256d inv_ds = _mm256_set1_pd(1.0 / c.ds());
+    const __m128i first = _mm_setzero_si128();
+    const __m128i last = _mm_set1_epi32((int) c.x.size() - 2);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d p_x = _mm256_loadu_pd(x + i);
+        __m256d p_y = _mm256_loadu_pd(y + i);
+        __m256d s_v = _mm256_loadu_pd(s + i);
+        __m256d d_v = _mm256_setzero_pd();
+        for (int k = 0; k <= kProjectIterations; k++) {
+            s_v = _mm256_sub_pd(s_v, _mm256_mul_pd(length, _mm256_floor_pd(_mm256_mul_pd(s_v, inv_length))));
+            __m256d pos = _mm256_mul_pd(s_v, inv_ds);
+            __m128i idx = _mm256_cvttpd_epi32(pos);
+            idx = _mm_max_epi32(_mm_min_epi32(idx, last), first);
+            __m256d t = _mm256_sub_pd(pos, _mm256_cvtepi32_pd(idx));
+
+            __m256d x0 = gather(c.x.data(), idx);
+            __m256d dx_c = _mm256_sub_pd(gather(c.x.data() + 1, idx), x0);
+            __m256d y0 = gather(c.y.data(), idx);
+            __m256d dy_c = _mm256_sub_pd(gather(c.y.data() + 1, idx), y0);
+            __m256d nx0 = gather(c.dx.data(), idx);
+            __m256d dx_n = _mm256_sub_pd(gather(c.dx.data() + 1, idx), nx0);
+            __m256d ny0 = gather(c.dy.data(), idx);
+            __m256d dy_n = _mm256_sub_pd(gather(c.dy.data() + 1, idx), ny0);
+
+            __m256d c_x = _mm256_add_pd(x0, _mm256_mul_pd(t, dx_c));
+            __m256d c_y = _mm256_add_pd(y0, _mm256_mul_pd(t, dy_c));
+            __m256d n_x = _mm256_add_pd(nx0, _mm256_mul_pd(t, dx_n));
+            __m256d n_y = _mm256_add_pd(ny0, _mm256_mul_pd(t, dy_n));
+            if (k == 0) {
+                d_v = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(p_x, c_x), n_x),
+                                    _mm256_mul_pd(_mm256_sub_pd(p_y, c_y), n_y));
+            }
+            if (k == kProjectIterations) {
+                break;
+            }
+
+            __m256d a_x = _mm256_mul_pd(_mm256_add_pd(dx_c, _mm256_mul_pd(d_v, dx_n)), inv_ds);
+            __m256d a_y = _mm256_mul_pd(_mm256_add_pd(dy_c, _mm256_mul_pd(d_v, dy_n)), inv_ds);
+            __m256d r_x = _mm256_sub_pd(p_x, _mm256_add_pd(c_x, _mm256_mul_pd(d_v, n_x)));
+            __m256d r_y = _mm256_sub_pd(p_y, _mm256_add_pd(c_y, _mm256_mul_pd(d_v, n_y)));
+            __m256d inv_det = _mm256_div_pd(_mm256_set1_pd(1.0),
+                                            _mm256_sub_pd(_mm256_mul_pd(a_x, n_y), _mm256_mul_pd(a_y, n_x)));
+            __m256d step_s = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(r_x, n_y), _mm256_mul_pd(r_y, n_x)), inv_det);
+            __m256d step_d = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(a_x, r_y), _mm256_mul_pd(a_y, r_x)), inv_det);
+            s_v = _mm256_add_pd(s_v, step_s);
+            d_v = _mm256_add_pd(d_v, step_d);
+        }
+        _mm256_storeu_pd(s + i, s_v);
+        _mm256_storeu_pd(d + i, d_v);
+    }
+    for (; i < n; i++) {
+        c.project(x[i], y[i], s[i], d[i]);
+    }
+}
+
+inline bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+} // namespace batch_detail
+
+// Transform n Frenet s,d coordinates to Cartesian x,y, see getXY
+inline void toXY(const double *s, const double *d, size_t n, double *x, double *y, const Map &map) {
+    if (map.centerline.empty()) {
+        return;
+    }
+#ifdef MAP_BATCH_X86
+    if (batch_detail::has_avx2()) {
+        batch_detail::to_xy_avx2(map, s, d, n, x, y);
+        return;
+    }
+#endif
+    batch_detail::to_xy_scalar(map, s, d, n, x, y);
+}
+
+// Projects n Cartesian x,y onto the smoothed centerline, see Centerline::project.
+// s holds the starting guesses, e.g. the s values of the previous frame, and receives the results.
+inline void refineFrenet(const double *x, const double *y, size_t n, double *s, double *d, const Map &map) {
+    if (map.centerline.empty()) {
+        return;
+    }
+#ifdef MAP_BATCH_X86
+    if (batch_detail::has_avx2()) {
+        batch_detail::project_avx2(map, x, y, n, s, d);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        map.centerline.project(x[i], y[i], s[i], d[i]);
+    }
+}
+
+// Transform n Cartesian x,y coordinates with headings theta to Frenet s,d, see getFrenet
+inline void toFrenet(const double *x, const double *y, const double *theta, size_t n, double *s, double *d,
+                     const Map &map) {
+    for (size_t i = 0; i < n; i++) {
+        getFrenetFrom(NextWaypoint(x[i], y[i], theta[i], map), x[i], y[i], map, s[i], d[i]);
+    }
+    refineFrenet(x, y, n, s, d, map);
+}
+
+#endif /* MAP_BATCH_H */
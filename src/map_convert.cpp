@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "map.h"
+#include "map_file.h"
+#include "map_tiles.h"
+
+using namespace std;
+
+static void write_array(FILE *out, const char *name, const char *size, const vector<double> &values) {
+    fprintf(out, "constexpr double %s[%s] = {", name, size);
+    for (size_t i = 0; i < values.size(); i++) {
+        fprintf(out, "%s%s%.17g", i ? "," : "", i % 4 ? " " : "\n    ", values[i]);
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+// Writes the map as a header of constexpr arrays, read by load_embedded_map()
+static bool save_map_header(const Map &map, const string &header_file) {
+    FILE *out = fopen(header_file.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+    fprintf(out, "// Generated by map_convert, do not edit.\n\n");
+    fprintf(out, "#ifndef EMBEDDED_MAP_H\n#define EMBEDDED_MAP_H\n\n#include <cstddef>\n\n");
+    fprintf(out, "namespace embedded_map {\n\n");
+    fprintf(out, "constexpr size_t kWaypoints = %zu;\n", map.size());
+    fprintf(out, "constexpr size_t kCenterlineSamples = %zu;\n", map.centerline.x.size());
+    fprintf(out, "constexpr double kCenterlineDs = %.17g;\n", map.centerline_ds);
+    fprintf(out, "constexpr double kMaxS = %.17g;\n\n", map.max_s);
+    write_array(out, "x", "kWaypoints", map.x);
+    write_array(out, "y", "kWaypoints", map.y);
+    write_array(out, "s", "kWaypoints", map.s);
+    write_array(out, "dx", "kWaypoints", map.dx);
+    write_array(out, "dy", "kWaypoints", map.dy);
+    write_array(out, "centerline_x", "kCenterlineSamples", map.centerline.x);
+    write_array(out, "centerline_y", "kCenterlineSamples", map.centerline.y);
+    write_array(out, "centerline_dx", "kCenterlineSamples", map.centerline.dx);
+    write_array(out, "centerline_dy", "kCenterlineSamples", map.centerline.dy);
+    fprintf(out, "} // namespace embedded_map\n\n#endif /* EMBEDDED_MAP_H */\n");
+    return fclose(out) == 0;
+}
+
+// Converts a waypoint csv into the compiled binary map format read by the planner,
+// into a header of constexpr arrays when the output file ends in .h,
+// or into a directory of map tiles when the output ends in /
+// usage: map_convert <highway_map.csv> <highway_map.bin|embedded_map.h> [centerline spacing in m]
+//        map_convert <highway_map.csv> <tile directory>/ [tile size in m]
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cerr << "usage: " << argv[0] << " <map.csv> <map.bin|map.h> [centerline_ds]" << endl;
+        cerr << "       " << argv[0] << " <map.csv> <tile_dir>/ [tile_size]" << endl;
+        return -1;
+    }
+
+    string out_file = argv[2];
+    if (out_file.back() == '/') {
+        double tile_size = argc > 3 ? atof(argv[3]) : kDefaultTileSize;
+        if (tile_size <= 0) {
+            cerr << "tile size has to be positive" << endl;
+            return -1;
+        }
+        Map map = load_map(argv[1]);
+        if (map.size() < 2 || !save_map_tiles(map, out_file, tile_size)) {
+            cerr << "Failed to write tiles to " << out_file << endl;
+            return -1;
+        }
+        cout << "Wrote " << map.size() << " waypoints as " << tile_size << " m tiles to " << out_file << endl;
+        return 0;
+    }
+
+    double centerline_ds = kDefaultCenterlineDs;
+    if (argc > 3) {
+        centerline_ds = atof(argv[3]);
+        if (centerline_ds <= 0) {
+            cerr << "centerline spacing has to be positive" << endl;
+            return -1;
+        }
+    }
+
+    Map map = load_map(argv[1], centerline_ds);
+    if (map.size() < 2) {
+        cerr << "Failed to read waypoints from " << argv[1] << endl;
+        return -1;
+    }
+
+    if (out_file.size() > 2 && out_file.compare(out_file.size() - 2, 2, ".h") == 0) {
+        if (!save_map_header(map, out_file)) {
+            cerr << "Failed to write " << out_file << endl;
+            return -1;
+        }
+        cout << "Wrote " << map.size() << " waypoints to " << out_file << endl;
+        return 0;
+    }
+
+    if (!save_map(map, argv[2])) {
+        cerr << "Failed to write " << argv[2] << endl;
+        return -1;
+    }
+
+    // read it back, so a broken file is noticed here and not at planner startup
+    Map check;
+    if (!load_map_file(argv[2], check) || check.size() != map.size()) {
+        cerr << "Failed to verify " << argv[2] << endl;
+        return -1;
+    }
+
+    cout << "Wrote " << map.size() << " waypoints, " << map.centerline.x.size() << " centerline samples to "
+         << argv[2] << endl;
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef MAP_EMBEDDED_H
+#define MAP_EMBEDDED_H
+
+#include "map.h"
+// generated at build time by map_convert, see EMBED_MAP in CMakeLists.txt
+#include "embedded_map.h"
+
+// Map compiled into the binary, for builds without file I/O at startup.
+// The waypoints and the spline fitted centerline samples come from the generated
+// constexpr arrays, only the cheap lookup tables are rebuilt.
+inline Map load_embedded_map() {
+    Map map;
+    map.x.assign(embedded_map::x, embedded_map::x + embedded_map::kWaypoints);
+    map.y.assign(embedded_map::y, embedded_map::y + embedded_map::kWaypoints);
+    map.s.assign(embedded_map::s, embedded_map::s + embedded_map::kWaypoints);
+    map.dx.assign(embedded_map::dx, embedded_map::dx + embedded_map::kWaypoints);
+    map.dy.assign(embedded_map::dy, embedded_map::dy + embedded_map::kWaypoints);
+    map.centerline_ds = embedded_map::kCenterlineDs;
+    map.build_lookup();
+    map.centerline.assign(embedded_map::centerline_x, embedded_map::centerline_y, embedded_map::centerline_dx,
+                          embedded_map::centerline_dy, embedded_map::kCenterlineSamples, embedded_map::kMaxS);
+    return map;
+}
+
+#endif /* MAP_EMBEDDED_H */
@@ -0,0 +1,132 @@
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binary_io.h"
+#include "map.h"
+
+// Compiled binary map format written by map_convert.
+// It holds the waypoints together with every table Map::build() derives from them,
+// so loading is a mmap and a copy of each array without parsing or rebuilding anything.
+//
+// layout: magic, version, byte order mark, then the Map members in the order of save_map
+const char kMapFileMagic[8] = {'P', 'P', 'M', 'A', 'P', 'B', 'I', 'N'};
+const uint32_t kMapFileVersion = 3;
+const uint32_t kMapFileByteOrder = 0x01020304;
+
+inline bool save_map(const Map &map, const std::string &map_file) {
+    std::ofstream out(map_file.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    BinaryWriter writer(out);
+    out.write(kMapFileMagic, sizeof(kMapFileMagic));
+    writer.value(kMapFileVersion);
+    writer.value(kMapFileByteOrder);
+
+    writer.array(map.x);
+    writer.array(map.y);
+    writer.array(map.s);
+    writer.array(map.dx);
+    writer.array(map.dy);
+    writer.array(map.cum_s);
+    writer.array(map.seg_tx);
+    writer.array(map.seg_ty);
+    writer.array(map.seg_nx);
+    writer.array(map.seg_ny);
+    writer.array(map.seg_len);
+    writer.value(map.max_s);
+    writer.array(map.s_bucket);
+    writer.value(map.s_bucket_len);
+    writer.value(map.centerline_ds);
+    map.centerline.save(writer);
+    map.index.save(writer);
+    map.lanes.save(writer);
+    return writer.good();
+}
+
+// Reads a map from a memory block holding a compiled map file
+inline bool read_map(const char *data, size_t size, Map &map) {
+    if (size < sizeof(kMapFileMagic) || memcmp(data, kMapFileMagic, sizeof(kMapFileMagic)) != 0) {
+        return false;
+    }
+    BinaryReader reader(data + sizeof(kMapFileMagic), size - sizeof(kMapFileMagic));
+    uint32_t version = 0;
+    uint32_t byte_order = 0;
+    reader.value(version);
+    reader.value(byte_order);
+    if (version != kMapFileVersion || byte_order != kMapFileByteOrder) {
+        return false;
+    }
+
+    reader.array(map.x);
+    reader.array(map.y);
+    reader.array(map.s);
+    reader.array(map.dx);
+    reader.array(map.dy);
+    reader.array(map.cum_s);
+    reader.array(map.seg_tx);
+    reader.array(map.seg_ty);
+    reader.array(map.seg_nx);
+    reader.array(map.seg_ny);
+    reader.array(map.seg_len);
+    reader.value(map.max_s);
+    reader.array(map.s_bucket);
+    reader.value(map.s_bucket_len);
+    reader.value(map.centerline_ds);
+    if (!map.centerline.load(reader) || !map.index.load(reader) || !map.lanes.load(reader)) {
+        return false;
+    }
+
+    size_t n = map.size();
+    if (n == 0 || map.y.size() != n || map.s.size() != n || map.dx.size() != n || map.dy.size() != n ||
+        map.cum_s.size() != n || map.seg_tx.size() != n || map.seg_ty.size() != n || map.seg_nx.size() != n ||
+        map.seg_ny.size() != n || map.seg_len.size() != n || map.lanes.segment_section.size() != n || map.s_bucket.empty() ||
+        !(map.s_bucket_len > 0) || !(map.max_s > 0) || map.centerline.length() != map.max_s) {
+        return false;
+    }
+    // the tables index each other, so a corrupted index fails here and not at query time
+    for (size_t k = 0; k < map.s_bucket.size(); k++) {
+        if (map.s_bucket[k] < 0 || map.s_bucket[k] >= (int) n) {
+            return false;
+        }
+    }
+    return map.index.indexes_waypoints(n);
+}
+
+// Maps a compiled map file into memory and reads it, returns false if the file is missing or invalid
+inline bool load_map_file(const std::string &map_file, Map &map) {
+    int fd = open(map_file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    bool ok = read_map(static_cast<const char *>(data), size, map);
+    munmap(data, size);
+    return ok;
+}
+
+// Loads a waypoint csv or a compiled map, depending on the file extension
+inline bool load_map_auto(const std::string &map_file, Map &map) {
+    if (map_file.size() > 4 && map_file.compare(map_file.size() - 4, 4, ".csv") == 0) {
+        map = load_map(map_file);
+        return map.size() >= 3 && !map.centerline.empty();
+    }
+    return load_map_file(map_file, map);
+}
+
+#endif /* MAP_FILE_H */
@@ -0,0 +1,128 @@
+#ifndef MAP_STORE_H
+#define MAP_STORE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+#include "map.h"
+#include "map_file.h"
+
+// Seconds between two checks of the watched map file
+const int kMapWatchInterval = 1;
+
+// Holds the current map snapshot and replaces it without restarting the planner.
+// Readers grab the snapshot once per frame and keep using it until the frame is done,
+// a reload builds the new map and all its tables on a background thread and then
+// publishes it with a single pointer swap. The old map is freed once the last frame
+// holding it drops its reference.
+class MapStore {
+public:
+    explicit MapStore(std::shared_ptr<const Map> map)
+        : m_map(map), m_mtime(-1), m_pending_mtime(-1), m_reload(false), m_stop(false) {}
+
+    ~MapStore() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+    }
+
+    MapStore(const MapStore &) = delete;
+    MapStore &operator=(const MapStore &) = delete;
+
+    // Current snapshot. Not lock free: libstdc++ guards atomic_load and atomic_store of a
+    // shared_ptr with a mutex from an internal pool, held only for the pointer copy, so a
+    // reader never waits for a reload to build its map.
+    std::shared_ptr<const Map> get() const {
+        return std::atomic_load(&m_map);
+    }
+
+    void publish(std::shared_ptr<const Map> map) {
+        std::atomic_store(&m_map, map);
+    }
+
+    // Starts the background thread that reloads map_file whenever it changes on disk
+    // or reload() is called. Must be called at most once.
+    // A change is only picked up once the modification time stayed the same for a whole
+    // poll interval, so a file that is still being written is not loaded half way.
+    void watch(const std::string &map_file) {
+        m_file = map_file;
+        m_mtime = modified(map_file);
+        m_pending_mtime = m_mtime;
+        m_worker = std::thread(&MapStore::run, this);
+    }
+
+    // Asks the background thread to reload the watched file now
+    void reload() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_reload = true;
+        }
+        m_wake.notify_one();
+    }
+
+private:
+    static long long modified(const std::string &file) {
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0) {
+            return -1;
+        }
+        return (long long) st.st_mtime;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop) {
+            m_wake.wait_for(lock, std::chrono::seconds(kMapWatchInterval), [this] { return m_stop || m_reload; });
+            if (m_stop) {
+                return;
+            }
+            long long mtime = modified(m_file);
+            if (!m_reload) {
+                bool settled = mtime == m_pending_mtime;
+                m_pending_mtime = mtime;
+                if (mtime == m_mtime || !settled) {
+                    continue;
+                }
+            }
+            m_reload = false;
+            m_mtime = mtime;
+            m_pending_mtime = mtime;
+
+            // build without holding the lock, so reload requests are not held up
+            lock.unlock();
+            std::shared_ptr<Map> map(new Map());
+            if (load_map_auto(m_file, *map)) {
+                publish(map);
+                std::cout << "Reloaded map " << m_file << std::endl;
+            } else {
+                std::cerr << "Failed to reload map " << m_file << ", keeping the old one" << std::endl;
+            }
+            lock.lock();
+        }
+    }
+
+    std::shared_ptr<const Map> m_map;
+
+    std::string m_file;
+    long long m_mtime;
+    // modification time seen by the last poll, a change is loaded once it repeats
+    long long m_pending_mtime;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_reload;
+    bool m_stop;
+    std::thread m_worker;
+};
+
+#endif /* MAP_STORE_H */
@@ -0,0 +1,371 @@
+#ifndef MAP_TILES_H
+#define MAP_TILES_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <math.h>
+#include "binary_io.h"
+#include "map.h"
+
+// Tiled storage for maps too large to keep in memory as a whole.
+// map_convert splits a map into square tiles, each holding the segments whose
+// bounding box overlaps it. TiledMap keeps a bounded number of tiles in an LRU
+// cache and loads missing ones on a background thread, so memory and per query
+// cost stay constant regardless of the total map size.
+// Tiles have no lane data and no spatial index of their own, a projection scans
+// the segments of the 3x3 tiles around the query point.
+
+const uint32_t kTileFileVersion = 1;
+const double kDefaultTileSize = 500;
+const char kTileMetaFile[] = "tiles.meta";
+
+// Segments of one tile, segment k runs from x0,y0 (at s0) to x1,y1 (at s1)
+struct MapTile {
+    int tx = 0;
+    int ty = 0;
+    std::vector<int> waypoint;          // waypoint at the start of the segment
+    std::vector<double> x0, y0, s0;
+    std::vector<double> x1, y1, s1;
+
+    size_t size() const { return waypoint.size(); }
+
+    void save(BinaryWriter &out) const {
+        out.value(kTileFileVersion);
+        out.value(tx);
+        out.value(ty);
+        out.array(waypoint);
+        out.array(x0);
+        out.array(y0);
+        out.array(s0);
+        out.array(x1);
+        out.array(y1);
+        out.array(s1);
+    }
+
+    bool load(BinaryReader &in) {
+        uint32_t version = 0;
+        in.value(version);
+        in.value(tx);
+        in.value(ty);
+        in.array(waypoint);
+        in.array(x0);
+        in.array(y0);
+        in.array(s0);
+        in.array(x1);
+        in.array(y1);
+        in.array(s1);
+        size_t n = waypoint.size();
+        return in.ok() && version == kTileFileVersion && x0.size() == n && y0.size() == n && s0.size() == n &&
+               x1.size() == n && y1.size() == n && s1.size() == n;
+    }
+
+    // Projects x,y onto the closest segment of the tile, returns false for an empty tile.
+    // d is positive to the right of the driving direction, like the map's d_x,d_y normals.
+    bool project(double x, double y, double &dist2, double &s, double &d) const {
+        bool found = false;
+        for (size_t k = 0; k < size(); k++) {
+            double n_x = x1[k] - x0[k];
+            double n_y = y1[k] - y0[k];
+            double x_x = x - x0[k];
+            double x_y = y - y0[k];
+            double len2 = n_x * n_x + n_y * n_y;
+            double t = len2 > 0 ? (x_x * n_x + x_y * n_y) / len2 : 0;
+            t = std::max(0.0, std::min(1.0, t));
+            double d_x = x_x - t * n_x;
+            double d_y = x_y - t * n_y;
+            double k_dist2 = d_x * d_x + d_y * d_y;
+            if (!found || k_dist2 < dist2) {
+                found = true;
+                dist2 = k_dist2;
+                s = s0[k] + t * (s1[k] - s0[k]);
+                // cross product of the segment direction and the offset, negative on the right side
+                double cross = n_x * x_y - n_y * x_x;
+                d = cross > 0 ? -sqrt(k_dist2) : sqrt(k_dist2);
+            }
+        }
+        return found;
+    }
+};
+
+inline std::string tile_file_name(const std::string &dir, int tx, int ty) {
+    std::ostringstream name;
+    name << dir << "/tile_" << tx << "_" << ty << ".bin";
+    return name.str();
+}
+
+// Splits the segments of a map into tiles of tile_size meters and writes them to dir
+inline bool save_map_tiles(const Map &map, const std::string &dir, double tile_size) {
+    std::map<std::pair<int, int>, MapTile> tiles;
+    int n = map.size();
+    for (int i = 0; i < n; i++) {
+        int j = (i + 1) % n;
+        double s_end = j == 0 ? map.max_s : map.s[j];
+        int tx0 = (int) floor(std::min(map.x[i], map.x[j]) / tile_size);
+        int tx1 = (int) floor(std::max(map.x[i], map.x[j]) / tile_size);
+        int ty0 = (int) floor(std::min(map.y[i], map.y[j]) / tile_size);
+        int ty1 = (int) floor(std::max(map.y[i], map.y[j]) / tile_size);
+        for (int tx = tx0; tx <= tx1; tx++) {
+            for (int ty = ty0; ty <= ty1; ty++) {
+                MapTile &tile = tiles[std::make_pair(tx, ty)];
+                tile.tx = tx;
+                tile.ty = ty;
+                tile.waypoint.push_back(i);
+                tile.x0.push_back(map.x[i]);
+                tile.y0.push_back(map.y[i]);
+                tile.s0.push_back(map.s[i]);
+                tile.x1.push_back(map.x[j]);
+                tile.y1.push_back(map.y[j]);
+                tile.s1.push_back(s_end);
+            }
+        }
+    }
+
+    for (auto &&entry : tiles) {
+        std::ofstream out(tile_file_name(dir, entry.second.tx, entry.second.ty).c_str(),
+                          std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        BinaryWriter writer(out);
+        entry.second.save(writer);
+        if (!writer.good()) {
+            return false;
+        }
+    }
+
+    std::ofstream meta((dir + "/" + kTileMetaFile).c_str(), std::ofstream::out | std::ofstream::binary);
+    BinaryWriter writer(meta);
+    writer.value(kTileFileVersion);
+    writer.value(tile_size);
+    writer.value(map.max_s);
+    return writer.good();
+}
+
+// LRU cache of map tiles backed by a tile directory written by save_map_tiles.
+// Lookups never block on I/O: a tile that is not resident is queued for the
+// loader thread and the lookup only uses what is already in memory.
+// Tiles a lookup needs are loaded before any prefetched ones.
+class TiledMap {
+public:
+    TiledMap(const std::string &dir, size_t capacity)
+            : m_dir(dir), m_capacity(std::max<size_t>(capacity, 9)), m_tile_size(0), m_max_s(0), m_stop(false) {
+        std::ifstream meta((dir + "/" + kTileMetaFile).c_str(), std::ifstream::in | std::ifstream::binary);
+        std::string data((std::istreambuf_iterator<char>(meta)), std::istreambuf_iterator<char>());
+        BinaryReader reader(data.data(), data.size());
+        uint32_t version = 0;
+        reader.value(version);
+        reader.value(m_tile_size);
+        reader.value(m_max_s);
+        if (!reader.ok() || version != kTileFileVersion || m_tile_size <= 0) {
+            m_tile_size = 0;
+            return;
+        }
+        m_loader = std::thread(&TiledMap::load_tiles, this);
+    }
+
+    ~TiledMap() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        if (m_loader.joinable()) {
+            m_loader.join();
+        }
+    }
+
+    TiledMap(const TiledMap &) = delete;
+    TiledMap &operator=(const TiledMap &) = delete;
+
+    bool valid() const { return m_tile_size > 0; }
+
+    double tile_size() const { return m_tile_size; }
+
+    double max_s() const { return m_max_s; }
+
+    // Resident tile at tx,ty or nullptr, in which case the tile is queued for loading
+    std::shared_ptr<const MapTile> tile(int tx, int ty) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return find(tx, ty, false);
+    }
+
+    // Frenet s,d of x,y from the tiles around it.
+    // Returns false while any of them is still being loaded, a projection onto
+    // only part of them could pick a wrong segment.
+    bool getFrenet(double x, double y, double &s, double &d) {
+        if (!valid()) {
+            return false;
+        }
+        int tx = (int) floor(x / m_tile_size);
+        int ty = (int) floor(y / m_tile_size);
+        std::shared_ptr<const MapTile> around[9];
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            bool complete = true;
+            for (int k = 0; k < 9; k++) {
+                TileKey key(tx + k % 3 - 1, ty + k / 3 - 1);
+                around[k] = find(key.first, key.second, false);
+                if (!around[k] && m_missing.count(key) == 0) {
+                    complete = false;
+                }
+            }
+            if (!complete) {
+                return false;
+            }
+        }
+        bool found = false;
+        double best = 0;
+        for (int k = 0; k < 9; k++) {
+            double dist2, tile_s, tile_d;
+            if (around[k] && around[k]->project(x, y, dist2, tile_s, tile_d) && (!found || dist2 < best)) {
+                found = true;
+                best = dist2;
+                s = tile_s;
+                d = tile_d;
+            }
+        }
+        return found;
+    }
+
+    // Queues the tiles along a predicted route, e.g. the planned path of the ego car,
+    // so they are resident by the time the car gets there. The route starts at the car.
+    // It replaces the backlog of the previous call and is cut after as many tiles as fit
+    // into the cache next to the 3x3 tiles around the car, so it cannot evict those.
+    void prefetch(const double *x, const double *y, size_t n) {
+        if (!valid()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &&key : m_prefetch) {
+            auto it = m_queued.find(key);
+            if (it != m_queued.end() && it->second) {
+                m_queued.erase(it);
+            }
+        }
+        m_prefetch.clear();
+        std::set<TileKey> route;
+        for (size_t i = 0; i < n && route.size() < m_capacity - 9; i++) {
+            int tx = (int) floor(x[i] / m_tile_size);
+            int ty = (int) floor(y[i] / m_tile_size);
+            if (route.insert(TileKey(tx, ty)).second) {
+                find(tx, ty, true);
+            }
+        }
+    }
+
+private:
+    typedef std::pair<int, int> TileKey;
+    typedef std::list<std::pair<TileKey, std::shared_ptr<const MapTile>>> LruList;
+
+    // Looks up a resident tile and marks it as most recently used, a missing tile is queued
+    // for a lookup or for prefetching. Has to be called with m_mutex held.
+    std::shared_ptr<const MapTile> find(int tx, int ty, bool prefetch) {
+        TileKey key(tx, ty);
+        auto it = m_resident.find(key);
+        if (it != m_resident.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return it->second->second;
+        }
+        if (m_missing.count(key) != 0) {
+            return nullptr;
+        }
+        auto queued = m_queued.find(key);
+        if (queued == m_queued.end()) {
+            m_queued[key] = prefetch;
+            (prefetch ? m_prefetch : m_queue).push_back(key);
+            m_wake.notify_one();
+        } else if (queued->second && !prefetch) {
+            // a lookup needs a tile waiting for prefetch, its entry there is skipped
+            queued->second = false;
+            m_queue.push_back(key);
+        }
+        return nullptr;
+    }
+
+    void load_tiles() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty() || !m_prefetch.empty(); });
+            if (m_stop) {
+                return;
+            }
+            TileKey key;
+            if (!m_queue.empty()) {
+                key = m_queue.front();
+                m_queue.pop_front();
+            } else {
+                key = m_prefetch.front();
+                m_prefetch.pop_front();
+                // dropped by a newer prefetch call or moved to the lookup queue
+                auto queued = m_queued.find(key);
+                if (queued == m_queued.end() || !queued->second) {
+                    continue;
+                }
+            }
+
+            // read the file without holding the lock, lookups keep going meanwhile
+            lock.unlock();
+            std::shared_ptr<MapTile> tile = read_tile(key.first, key.second);
+            lock.lock();
+
+            m_queued.erase(key);
+            if (!tile) {
+                // no segments in that tile, do not ask again
+                if (m_missing.size() >= 16 * m_capacity) {
+                    m_missing.clear();
+                }
+                m_missing.insert(key);
+                continue;
+            }
+            m_lru.push_front(std::make_pair(key, std::shared_ptr<const MapTile>(tile)));
+            m_resident[key] = m_lru.begin();
+            while (m_lru.size() > m_capacity) {
+                // tiles still referenced by a lookup stay alive until it drops them
+                m_resident.erase(m_lru.back().first);
+                m_lru.pop_back();
+            }
+        }
+    }
+
+    std::shared_ptr<MapTile> read_tile(int tx, int ty) const {
+        std::ifstream in(tile_file_name(m_dir, tx, ty).c_str(), std::ifstream::in | std::ifstream::binary);
+        if (!in) {
+            return nullptr;
+        }
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        BinaryReader reader(data.data(), data.size());
+        std::shared_ptr<MapTile> tile(new MapTile());
+        if (!tile->load(reader)) {
+            return nullptr;
+        }
+        return tile;
+    }
+
+    std::string m_dir;
+    size_t m_capacity;
+    double m_tile_size;
+    double m_max_s;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop;
+    LruList m_lru;                                  // most recently used first
+    std::map<TileKey, LruList::iterator> m_resident;
+    std::deque<TileKey> m_queue;                    // tiles lookups are waiting for
+    std::deque<TileKey> m_prefetch;                 // tiles along the predicted route
+    std::map<TileKey, bool> m_queued;               // queued tiles, true while only prefetched
+    std::set<TileKey> m_missing;
+    std::thread m_loader;
+};
+
+#endif /* MAP_TILES_H */
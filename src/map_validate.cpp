@@ -0,0 +1,60 @@
+#include <iostream>
+#include <string>
+#include "centerline_compact.h"
+#include "map.h"
+#include "map_file.h"
+
+using namespace std;
+
+// Compares the reduced precision centerline against the double reference of a map
+// and checks the documented error bound of CompactCenterline.
+// usage: map_validate <map.csv|map.bin>
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <map.csv|map.bin>" << endl;
+        return -1;
+    }
+
+    string map_file = argv[1];
+    Map map;
+    if (!load_map_auto(map_file, map)) {
+        cerr << "Failed to load map " << map_file << endl;
+        return -1;
+    }
+
+    CompactCenterline compact;
+    if (!compact.build(map.centerline)) {
+        cerr << "Map does not fit into the fixed point range" << endl;
+        return -1;
+    }
+
+    // several points per sample interval, across all lanes and a bit beyond
+    double step = map.centerline.ds() / 7;
+    double max_error = 0;
+    double max_ratio = 0;
+    long points = 0;
+    for (double s = 0; s < map.max_s; s += step) {
+        for (double d = -2; d <= 14; d += 0.5) {
+            double ref_x, ref_y, x, y;
+            map.centerline.to_xy(s, d, ref_x, ref_y);
+            compact.to_xy(s, d, x, y);
+            double error = sqrt((x - ref_x) * (x - ref_x) + (y - ref_y) * (y - ref_y));
+            max_error = max(max_error, error);
+            max_ratio = max(max_ratio, error / CompactCenterline::error_bound(d));
+            points++;
+        }
+    }
+
+    size_t ref_bytes = map.centerline.x.size() * 4 * sizeof(double);
+    size_t compact_bytes = compact.x.size() * (2 * sizeof(int32_t) + 2 * sizeof(float));
+    cout << "Checked " << points << " points, max error " << max_error * 1000 << " mm, "
+         << max_ratio * 100 << " % of the bound" << endl;
+    cout << "Centerline " << ref_bytes << " bytes as double, " << compact_bytes << " bytes compact" << endl;
+
+    // allow for the rounding of the double arithmetic itself
+    if (max_ratio > 1 + 1e-6) {
+        cerr << "Error bound exceeded" << endl;
+        return -1;
+    }
+    return 0;
+}
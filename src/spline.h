@@ -29,9 +29,17 @@
 
 #include <cstdio>
 #include <cassert>
+#include <cmath>
 #include <vector>
+#include <array>
 #include <algorithm>
 
+// the batched evaluation picks an AVX2 kernel at runtime on x86
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TK_SPLINE_X86 1
+#include <immintrin.h>
+#endif
+
 
 // unnamed namespace only because the implementation is in this
 // header file and we don't want to export symbols to the obj files
@@ -41,40 +49,67 @@ namespace
 namespace tk
 {
 
-// band matrix solver
-class band_matrix
-{
-private:
-    std::vector< std::vector<double> > m_upper;  // upper band
-    std::vector< std::vector<double> > m_lower;  // lower band
-public:
-    band_matrix() {};                             // constructor
-    band_matrix(int dim, int n_u, int n_l);       // constructor
-    ~band_matrix() {};                            // destructor
-    void resize(int dim, int n_u, int n_l);      // init with dim,n_u,n_l
-    int dim() const;                             // matrix dimension
-    int num_upper() const
-    {
-        return m_upper.size()-1;
-    }
-    int num_lower() const
-    {
-        return m_lower.size()-1;
-    }
-    // access operator
-    double & operator () (int i, int j);            // write
-    double   operator () (int i, int j) const;      // read
-    // we can store an additional diogonal (in m_lower)
-    double& saved_diag(int i);
-    double  saved_diag(int i) const;
-    void lu_decompose();
-    std::vector<double> r_solve(const std::vector<double>& b) const;
-    std::vector<double> l_solve(const std::vector<double>& b) const;
-    std::vector<double> lu_solve(const std::vector<double>& b,
-                                 bool is_lu_decomposed=false);
+// solves a tridiagonal system in place (Thomas algorithm), no pivoting,
+// l: sub-diagonal (l[0] unused), d: diagonal (overwritten),
+// u: super-diagonal (u[n-1] unused), b: right hand side, receives the solution
+void tridiagonal_solve(int n, const double* l, double* d, const double* u,
+                       double* b);
+
+// same for a cyclic tridiagonal system (Sherman-Morrison correction of two
+// tridiagonal solves), l[0] and u[n-1] are the corner entries A(0,n-1) and
+// A(n-1,0), work holds 2*n doubles, n>=3
+void cyclic_tridiagonal_solve(int n, const double* l, double* d,
+                              const double* u, double* b, double* work);
+
+// evaluates the piecewise cubic with knots px[0..n-1] and coefficients a,b,c
+// (left extrapolation b0,c0), or its order-th derivative, at the count
+// points xs, which should be sorted in increasing order, unsorted input is
+// correct but slow
+void piecewise_evaluate(int n, const double* px, const double* py,
+                        const double* a, const double* b, const double* c,
+                        double b0, double c0,
+                        const double* xs, size_t count, double* out,
+                        int order=0);
+
+#ifdef TK_SPLINE_X86
+// whether the cpu we run on has AVX2, checked once
+bool has_avx2();
+#endif
 
+// coefficients of the order-th derivative of a*h^3 + b*h^2 + c*h + y,
+// in the same form
+void derive_cubic(int order, double& a, double& b, double& c, double& y);
+
+// piecewise cubic plane curve r(t) = (x(t), y(t)) over the knots
+// t[0..n-1], per coordinate f(t) = a*h^3 + b*h^2 + c*h + f_i with h=t-t[i]
+// and the extrapolation left of t[0] given by b0,c0, the arrays are the
+// ones of the splines, the graph (t,f(t)) of a spline has no x
+// coefficients (xa==NULL)
+struct plane_curve {
+    int n;
+    const double* t;
+    const double* xa;
+    const double* xb;
+    const double* xc;
+    double xb0, xc0;
+    const double* ya;
+    const double* yb;
+    const double* yc;
+    double yb0, yc0;
 };
 
+// len[i] = arc length of the curve from t[0] to t[i]
+void piecewise_arc_length(const plane_curve& r, double* len);
+
+// arc length from t[0] to t, negative for t<t[0]
+double piecewise_arc_length_at(const plane_curve& r, const double* len,
+                               double t);
+
+// ts[k] = the parameter at arc length s0+(k+1)*ds from t[0], inverts the
+// len table with a few Newton steps per point
+void piecewise_sample_arc_length(const plane_curve& r, const double* len,
+                                 double s0, double ds, size_t count,
+                                 double* ts);
 
 // spline interpolation
 class spline
@@ -94,6 +129,20 @@ private:
     bd_type m_left, m_right;
     double  m_left_value, m_right_value;
     bool    m_force_linear_extrapolation;
+    std::vector<double> m_work;             // tridiagonal system storage
+    std::vector<double> m_len;              // arc length up to each point
+
+    // computes the coefficients for the points in m_x, m_y
+    void fit(bool cubic_spline);
+
+    // the graph (x,f(x)) for the arc length functions
+    plane_curve graph() const
+    {
+        plane_curve r= {int(m_x.size()), m_x.data(), NULL, NULL, NULL, 0.0, 0.0,
+                        m_a.data(), m_b.data(), m_c.data(), m_b0, m_c0
+                       };
+        return r;
+    }
 
 public:
     // set default boundary condition to be zero curvature at both ends
@@ -104,15 +153,334 @@ public:
         ;
     }
 
+    // optional, but if called it has to come be before set_points()
+    void set_boundary(bd_type left, double left_value,
+                      bd_type right, double right_value,
+                      bool force_linear_extrapolation=false)
+    {
+        assert(m_x.size()==0);          // set_points() must not have happened yet
+        m_left=left;
+        m_right=right;
+        m_left_value=left_value;
+        m_right_value=right_value;
+        m_force_linear_extrapolation=force_linear_extrapolation;
+    }
+    // all buffers keep their capacity, so refitting a long lived spline
+    // with at most as many points as before does not allocate
+    void set_points(const std::vector<double>& x,
+                    const std::vector<double>& y, bool cubic_spline=true)
+    {
+        assert(x.size()==y.size());
+        m_x=x;
+        m_y=y;
+        fit(cubic_spline);
+    }
+    // takes over the storage of x and y without copying, they get the
+    // previous points back so refilling them for the next fit reuses it
+    void set_points(std::vector<double>&& x, std::vector<double>&& y,
+                    bool cubic_spline=true)
+    {
+        assert(x.size()==y.size());
+        m_x.swap(x);
+        m_y.swap(y);
+        fit(cubic_spline);
+    }
+    // n points from plain arrays
+    void set_points(const double* x, const double* y, size_t n,
+                    bool cubic_spline=true)
+    {
+        m_x.assign(x, x+n);
+        m_y.assign(y, y+n);
+        fit(cubic_spline);
+    }
+    double operator() (double x) const
+    {
+        size_t n=m_x.size();
+        // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
+        std::vector<double>::const_iterator it;
+        it=std::lower_bound(m_x.begin(),m_x.end(),x);
+        int idx=std::max( int(it-m_x.begin())-1, 0);
+
+        double h=x-m_x[idx];
+        double interpol;
+        if(x<m_x[0]) {
+            // extrapolation to the left
+            interpol=(m_b0*h + m_c0)*h + m_y[0];
+        } else if(x>m_x[n-1]) {
+            // extrapolation to the right
+            interpol=(m_b[n-1]*h + m_c[n-1])*h + m_y[n-1];
+        } else {
+            // interpolation
+            interpol=((m_a[idx]*h + m_b[idx])*h + m_c[idx])*h + m_y[idx];
+        }
+        return interpol;
+    }
+    // out[i] = f(xs[i]) for n points in increasing order, walks the
+    // segments once instead of searching for every point
+    void evaluate(const double* xs, size_t n, double* out) const
+    {
+        piecewise_evaluate(m_x.size(), m_x.data(), m_y.data(), m_a.data(),
+                           m_b.data(), m_c.data(), m_b0, m_c0, xs, n, out);
+    }
+    // order-th derivative (order>0) straight from the coefficients,
+    // zero from order 4 on, and the batch form of it
+    void deriv(int order, const double* xs, size_t n, double* out) const
+    {
+        assert(order>0);
+        piecewise_evaluate(m_x.size(), m_x.data(), m_y.data(), m_a.data(),
+                           m_b.data(), m_c.data(), m_b0, m_c0, xs, n, out,
+                           order);
+    }
+    double deriv(int order, double x) const
+    {
+        double out;
+        deriv(order, &x, 1, &out);
+        return out;
+    }
+    // arc length of the curve (x,f(x)) from the first point to x
+    double arc_length(double x) const
+    {
+        return piecewise_arc_length_at(graph(), m_len.data(), x);
+    }
+    // xs[k] = the x that is (k+1)*ds further along the curve than x0,
+    // evenly spaced points on the curve rather than in x
+    void sample_arc_length(double x0, double ds, size_t n, double* xs) const
+    {
+        piecewise_sample_arc_length(graph(), m_len.data(), arc_length(x0),
+                                    ds, n, xs);
+    }
+};
+
+
+template<int N> class spline_pack;
+
+// cubic spline through a fixed number N of points, same interface as
+// spline but all storage is inline (no heap) and the loops have compile
+// time trip counts, meant for the small fits of the path planner
+template<int N>
+class fixed_spline
+{
+public:
+    enum bd_type {
+        first_deriv = 1,
+        second_deriv = 2
+    };
+
+private:
+    std::array<double,N> m_x,m_y;           // x,y coordinates of points
+    // f(x) = a*(x-x_i)^3 + b*(x-x_i)^2 + c*(x-x_i) + y_i
+    std::array<double,N> m_a,m_b,m_c;       // spline coefficients
+    double  m_b0, m_c0;                     // for left extrapol
+    bd_type m_left, m_right;
+    double  m_left_value, m_right_value;
+    bool    m_force_linear_extrapolation;
+    std::array<double,N> m_len;             // arc length up to each point
+
+    plane_curve graph() const
+    {
+        plane_curve r= {N, m_x.data(), NULL, NULL, NULL, 0.0, 0.0,
+                        m_a.data(), m_b.data(), m_c.data(), m_b0, m_c0
+                       };
+        return r;
+    }
+
+    friend class spline_pack<N>;
+
+public:
+    static_assert(N>2, "a spline needs at least 3 points");
+
+    // set default boundary condition to be zero curvature at both ends
+    fixed_spline(): m_left(second_deriv), m_right(second_deriv),
+        m_left_value(0.0), m_right_value(0.0),
+        m_force_linear_extrapolation(false)
+    {
+        ;
+    }
+
     // optional, but if called it has to come be before set_points()
     void set_boundary(bd_type left, double left_value,
                       bd_type right, double right_value,
                       bool force_linear_extrapolation=false);
+    // x and y hold N values each
+    void set_points(const double* x, const double* y, bool cubic_spline=true);
+    void set_points(const std::array<double,N>& x,
+                    const std::array<double,N>& y, bool cubic_spline=true)
+    {
+        set_points(x.data(), y.data(), cubic_spline);
+    }
+    double operator() (double x) const;
+    // see spline::evaluate()
+    void evaluate(const double* xs, size_t n, double* out) const
+    {
+        piecewise_evaluate(N, m_x.data(), m_y.data(), m_a.data(), m_b.data(),
+                           m_c.data(), m_b0, m_c0, xs, n, out);
+    }
+    // see spline::deriv()
+    void deriv(int order, const double* xs, size_t n, double* out) const
+    {
+        assert(order>0);
+        piecewise_evaluate(N, m_x.data(), m_y.data(), m_a.data(), m_b.data(),
+                           m_c.data(), m_b0, m_c0, xs, n, out, order);
+    }
+    double deriv(int order, double x) const
+    {
+        double out;
+        deriv(order, &x, 1, &out);
+        return out;
+    }
+    // see spline::arc_length() and spline::sample_arc_length()
+    double arc_length(double x) const
+    {
+        return piecewise_arc_length_at(graph(), m_len.data(), x);
+    }
+    void sample_arc_length(double x0, double ds, size_t n, double* xs) const
+    {
+        piecewise_sample_arc_length(graph(), m_len.data(), arc_length(x0),
+                                    ds, n, xs);
+    }
+};
+
+
+// parametric cubic spline r(t) = (x(t), y(t)) through N points of the
+// plane, t is the chord length along the points so x need not increase
+// and the curve may turn any way, both coordinates share the one
+// tridiagonal system, zero curvature at both ends
+template<int N>
+class fixed_spline2d
+{
+private:
+    std::array<double,N> m_t;               // parameter of the points
+    std::array<double,N> m_x,m_y;           // x,y coordinates of points
+    // x(t) = xa*(t-t_i)^3 + xb*(t-t_i)^2 + xc*(t-t_i) + x_i, same for y
+    std::array<double,N> m_xa,m_xb,m_xc;
+    std::array<double,N> m_ya,m_yb,m_yc;
+    double  m_xb0, m_xc0, m_yb0, m_yc0;     // for left extrapol
+    std::array<double,N> m_len;             // arc length up to each point
+
+    plane_curve curve() const
+    {
+        plane_curve r= {N, m_t.data(),
+                        m_xa.data(), m_xb.data(), m_xc.data(), m_xb0, m_xc0,
+                        m_ya.data(), m_yb.data(), m_yc.data(), m_yb0, m_yc0
+                       };
+        return r;
+    }
+
+public:
+    static_assert(N>2, "a spline needs at least 3 points");
+
+    // x and y hold N values each, consecutive points must differ
+    void set_points(const double* x, const double* y);
+    // parameter of point i
+    double knot(int i) const
+    {
+        return m_t[i];
+    }
+    // xs[i], ys[i] = r(ts[i]) for n parameters in increasing order
+    void evaluate(const double* ts, size_t n, double* xs, double* ys) const
+    {
+        piecewise_evaluate(N, m_t.data(), m_x.data(), m_xa.data(),
+                           m_xb.data(), m_xc.data(), m_xb0, m_xc0, ts, n, xs);
+        piecewise_evaluate(N, m_t.data(), m_y.data(), m_ya.data(),
+                           m_yb.data(), m_yc.data(), m_yb0, m_yc0, ts, n, ys);
+    }
+    // see spline::arc_length() and spline::sample_arc_length()
+    double arc_length(double t) const
+    {
+        return piecewise_arc_length_at(curve(), m_len.data(), t);
+    }
+    void sample_arc_length(double t0, double ds, size_t n, double* ts) const
+    {
+        piecewise_sample_arc_length(curve(), m_len.data(), arc_length(t0),
+                                    ds, n, ts);
+    }
+};
+
+
+// cubic spline through the points of a closed loop, f(x+period) = f(x)
+// and smooth across the seam, any x is wrapped into the period and its
+// segment found in constant time through a bucket table
+class periodic_spline
+{
+private:
+    std::vector<double> m_x,m_y;            // x,y coordinates of points
+    // f(x) = a*(x-x_i)^3 + b*(x-x_i)^2 + c*(x-x_i) + y_i, the last segment
+    // runs from x_{n-1} to x_0+period
+    std::vector<double> m_a,m_b,m_c;        // spline coefficients
+    double  m_period;
+    // m_bucket[k] is the segment containing x_0+k*m_bucket_len
+    std::vector<int> m_bucket;
+    double  m_bucket_len;
+    std::vector<double> m_work;             // cyclic system storage
+
+public:
+    periodic_spline(): m_period(0.0), m_bucket_len(1.0)
+    {
+        ;
+    }
+
+    // x strictly increasing with x[n-1] < x[0]+period, at least 3 points
     void set_points(const std::vector<double>& x,
-                    const std::vector<double>& y, bool cubic_spline=true);
+                    const std::vector<double>& y, double period);
+    double period() const
+    {
+        return m_period;
+    }
     double operator() (double x) const;
 };
 
+// K fixed_spline<N> stored interleaved in blocks of four (one AVX2
+// register) and evaluated together at the same x, e.g. the candidate
+// trajectories of a frame, the cost grows with K/4 rather than K
+template<int N>
+class spline_pack
+{
+private:
+    // piece 0 is the left extrapolation, piece i+1 segment i of a spline
+    // (piece N the right extrapolation), every entry holds the four
+    // splines of the block
+    struct block {
+        double knot[N+1][4];                // start of the piece
+        double a[N+1][4], b[N+1][4], c[N+1][4], y[N+1][4];
+    };
+    std::vector<block> m_blocks;
+    size_t m_size;
+
+    void evaluate_scalar(double x, double* out) const;
+#ifdef TK_SPLINE_X86
+    void evaluate_avx2(double x, double* out) const;
+#endif
+
+public:
+    spline_pack(): m_size(0)
+    {
+        ;
+    }
+
+    // keeps the storage for the next frame's splines
+    void clear()
+    {
+        m_blocks.clear();
+        m_size=0;
+    }
+    size_t size() const
+    {
+        return m_size;
+    }
+    void add(const fixed_spline<N>& s);
+    // out[k] = spline k at x, for all size() splines, same results as
+    // fixed_spline::operator()
+    void evaluate(double x, double* out) const
+    {
+#ifdef TK_SPLINE_X86
+        if(has_avx2()) {
+            evaluate_avx2(x, out);
+            return;
+        }
+#endif
+        evaluate_scalar(x, out);
+    }
+};
 
 
 // ---------------------------------------------------------------------
@@ -120,174 +488,338 @@ public:
 // ---------------------------------------------------------------------
 
 
-// band_matrix implementation
+// tridiagonal solver
 // -------------------------
 
-band_matrix::band_matrix(int dim, int n_u, int n_l)
+void tridiagonal_solve(int n, const double* l, double* d, const double* u,
+                       double* b)
 {
-    resize(dim, n_u, n_l);
+    assert(n>0);
+    // forward elimination of the sub-diagonal
+    for(int i=1; i<n; i++) {
+        assert(d[i-1]!=0.0);
+        double w=l[i]/d[i-1];
+        d[i] -= w*u[i-1];
+        b[i] -= w*b[i-1];
+    }
+    // back substitution
+    assert(d[n-1]!=0.0);
+    b[n-1] /= d[n-1];
+    for(int i=n-2; i>=0; i--) {
+        b[i]=(b[i]-u[i]*b[i+1])/d[i];
+    }
 }
-void band_matrix::resize(int dim, int n_u, int n_l)
+
+
+void cyclic_tridiagonal_solve(int n, const double* l, double* d,
+                              const double* u, double* b, double* work)
 {
-    assert(dim>0);
-    assert(n_u>=0);
-    assert(n_l>=0);
-    m_upper.resize(n_u+1);
-    m_lower.resize(n_l+1);
-    for(size_t i=0; i<m_upper.size(); i++) {
-        m_upper[i].resize(dim);
+    assert(n>=3);
+    // A = T + v w^T with v = (gamma,0,..,0,alpha), w = (1,0,..,0,beta/gamma)
+    // and T tridiagonal, then A^-1 b follows from T^-1 b and T^-1 v
+    double alpha=u[n-1];
+    double beta=l[0];
+    double gamma=-d[0];
+    d[0] -= gamma;
+    d[n-1] -= alpha*beta/gamma;
+    double* d_copy=work;
+    double* z=work+n;
+    for(int i=0; i<n; i++) {
+        d_copy[i]=d[i];
+        z[i]=0.0;
     }
-    for(size_t i=0; i<m_lower.size(); i++) {
-        m_lower[i].resize(dim);
+    z[0]=gamma;
+    z[n-1]=alpha;
+    tridiagonal_solve(n, l, d, u, b);
+    tridiagonal_solve(n, l, d_copy, u, z);
+    double fact=(b[0]+beta*b[n-1]/gamma)/(1.0+z[0]+beta*z[n-1]/gamma);
+    for(int i=0; i<n; i++) {
+        b[i] -= fact*z[i];
     }
 }
-int band_matrix::dim() const
+
+
+// batched evaluation
+// -------------------------
+
+// out[i] = ((a*h + b)*h + c)*h + y with h = xs[i]-x0, the cubic of one segment
+void horner_scalar(const double* xs, size_t n, double x0, double a, double b,
+                   double c, double y, double* out)
 {
-    if(m_upper.size()>0) {
-        return m_upper[0].size();
-    } else {
-        return 0;
+    for(size_t i=0; i<n; i++) {
+        double h=xs[i]-x0;
+        out[i]=((a*h + b)*h + c)*h + y;
     }
 }
 
-
-// defines the new operator (), so that we can access the elements
-// by A(i,j), index going from i=0,...,dim()-1
-double & band_matrix::operator () (int i, int j)
+#ifdef TK_SPLINE_X86
+// four points per iteration, no fma so the results equal operator()
+__attribute__((target("avx2")))
+void horner_avx2(const double* xs, size_t n, double x0, double a, double b,
+                 double c, double y, double* out)
 {
-    int k=j-i;       // what band is the entry
-    assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
-    assert( (-num_lower()<=k) && (k<=num_upper()) );
-    // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
+    const __m256d x0_v=_mm256_set1_pd(x0);
+    const __m256d a_v=_mm256_set1_pd(a);
+    const __m256d b_v=_mm256_set1_pd(b);
+    const __m256d c_v=_mm256_set1_pd(c);
+    const __m256d y_v=_mm256_set1_pd(y);
+    size_t i=0;
+    for(; i+4<=n; i+=4) {
+        __m256d h=_mm256_sub_pd(_mm256_loadu_pd(xs+i), x0_v);
+        __m256d r=_mm256_add_pd(_mm256_mul_pd(a_v, h), b_v);
+        r=_mm256_add_pd(_mm256_mul_pd(r, h), c_v);
+        r=_mm256_add_pd(_mm256_mul_pd(r, h), y_v);
+        _mm256_storeu_pd(out+i, r);
+    }
+    horner_scalar(xs+i, n-i, x0, a, b, c, y, out+i);
 }
-double band_matrix::operator () (int i, int j) const
+
+bool has_avx2()
 {
-    int k=j-i;       // what band is the entry
-    assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
-    assert( (-num_lower()<=k) && (k<=num_upper()) );
-    // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
+    static const bool supported=__builtin_cpu_supports("avx2");
+    return supported;
 }
-// second diag (used in LU decomposition), saved in m_lower
-double band_matrix::saved_diag(int i) const
+#endif
+
+// whether x falls into segment seg with the same rule as operator():
+// -1 is the left extrapolation x<px[0], 0 is [px[0],px[1]], i is
+// (px[i],px[i+1]] and n-1 the right extrapolation x>px[n-1]
+bool in_segment(int seg, int n, const double* px, double x)
 {
-    assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
+    if(seg<0)    return x<px[0];
+    if(seg==0 && x<px[0])  return false;
+    if(seg>0 && x<=px[seg]) return false;
+    return seg==n-1 || x<=px[seg+1];
 }
-double & band_matrix::saved_diag(int i)
+
+void derive_cubic(int order, double& a, double& b, double& c, double& y)
 {
-    assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
+    switch(order) {
+    case 0:
+        break;
+    case 1:
+        y=c;
+        c=2.0*b;
+        b=3.0*a;
+        a=0.0;
+        break;
+    case 2:
+        y=2.0*b;
+        c=6.0*a;
+        b=0.0;
+        a=0.0;
+        break;
+    case 3:
+        y=6.0*a;
+        c=b=a=0.0;
+        break;
+    default:
+        y=c=b=a=0.0;
+        break;
+    }
 }
 
-// LR-Decomposition of a band matrix
-void band_matrix::lu_decompose()
+void piecewise_evaluate(int n, const double* px, const double* py,
+                        const double* a, const double* b, const double* c,
+                        double b0, double c0,
+                        const double* xs, size_t count, double* out,
+                        int order)
 {
-    int  i_max,j_max;
-    int  j_min;
-    double x;
-
-    // preconditioning
-    // normalize column i so that a_ii=1
-    for(int i=0; i<this->dim(); i++) {
-        assert(this->operator()(i,i)!=0.0);
-        this->saved_diag(i)=1.0/this->operator()(i,i);
-        j_min=std::max(0,i-this->num_lower());
-        j_max=std::min(this->dim()-1,i+this->num_upper());
-        for(int j=j_min; j<=j_max; j++) {
-            this->operator()(i,j) *= this->saved_diag(i);
-        }
-        this->operator()(i,i)=1.0;          // prevents rounding errors
-    }
-
-    // Gauss LR-Decomposition
-    for(int k=0; k<this->dim(); k++) {
-        i_max=std::min(this->dim()-1,k+this->num_lower());  // num_lower not a mistake!
-        for(int i=k+1; i<=i_max; i++) {
-            assert(this->operator()(k,k)!=0.0);
-            x=-this->operator()(i,k)/this->operator()(k,k);
-            this->operator()(i,k)=-x;                         // assembly part of L
-            j_max=std::min(this->dim()-1,k+this->num_upper());
-            for(int j=k+1; j<=j_max; j++) {
-                // assembly part of R
-                this->operator()(i,j)=this->operator()(i,j)+x*this->operator()(k,j);
+    int seg=-1;
+    size_t k=0;
+    while(k<count) {
+        // monotone cursor, walks forward and only searches for the
+        // segment on the first point and when xs goes backwards
+        if(!in_segment(seg, n, px, xs[k])) {
+            if(k==0 || xs[k]<xs[k-1]) {
+                seg=int(std::lower_bound(px, px+n, xs[k])-px)-1;
+                if(seg<0 && xs[k]>=px[0]) seg=0;
+            } else {
+                while(seg<n-1 && !in_segment(seg, n, px, xs[k])) seg++;
             }
         }
+        size_t end=k+1;
+        while(end<count && in_segment(seg, n, px, xs[end])) end++;
+
+        // the left extrapolation is the quadratic through px[0]
+        double x0=px[std::max(seg,0)];
+        double y0=py[std::max(seg,0)];
+        double sa=(seg<0) ? 0.0 : a[seg];
+        double sb=(seg<0) ? b0  : b[seg];
+        double sc=(seg<0) ? c0  : c[seg];
+        derive_cubic(order, sa, sb, sc, y0);
+#ifdef TK_SPLINE_X86
+        if(has_avx2()) {
+            horner_avx2(xs+k, end-k, x0, sa, sb, sc, y0, out+k);
+        } else {
+            horner_scalar(xs+k, end-k, x0, sa, sb, sc, y0, out+k);
+        }
+#else
+        horner_scalar(xs+k, end-k, x0, sa, sb, sc, y0, out+k);
+#endif
+        k=end;
     }
 }
-// solves Ly=b
-std::vector<double> band_matrix::l_solve(const std::vector<double>& b) const
+
+
+// arc length
+// -------------------------
+
+// one piece of a plane_curve, the constant terms do not matter here
+struct curve_segment {
+    double xa, xb, xc;
+    double ya, yb, yc;
+};
+
+curve_segment curve_segment_at(const plane_curve& r, int seg)
 {
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
-    int j_start;
-    double sum;
-    for(int i=0; i<this->dim(); i++) {
-        sum=0;
-        j_start=std::max(0,i-this->num_lower());
-        for(int j=j_start; j<i; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=(b[i]*this->saved_diag(i)) - sum;
-    }
-    return x;
+    curve_segment q;
+    if(r.xa==NULL) {
+        q.xa=0.0;
+        q.xb=0.0;
+        q.xc=1.0;
+    } else {
+        q.xa=(seg<0) ? 0.0   : r.xa[seg];
+        q.xb=(seg<0) ? r.xb0 : r.xb[seg];
+        q.xc=(seg<0) ? r.xc0 : r.xc[seg];
+    }
+    q.ya=(seg<0) ? 0.0   : r.ya[seg];
+    q.yb=(seg<0) ? r.yb0 : r.yb[seg];
+    q.yc=(seg<0) ? r.yc0 : r.yc[seg];
+    return q;
 }
-// solves Rx=y
-std::vector<double> band_matrix::r_solve(const std::vector<double>& b) const
+
+// |r'(h)|
+double curve_speed(const curve_segment& q, double h)
 {
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
-    int j_stop;
-    double sum;
-    for(int i=this->dim()-1; i>=0; i--) {
-        sum=0;
-        j_stop=std::min(this->dim()-1,i+this->num_upper());
-        for(int j=i+1; j<=j_stop; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=( b[i] - sum ) / this->operator()(i,i);
-    }
-    return x;
+    double dx=(3.0*q.xa*h + 2.0*q.xb)*h + q.xc;
+    double dy=(3.0*q.ya*h + 2.0*q.yb)*h + q.yc;
+    return std::sqrt(dx*dx+dy*dy);
 }
 
-std::vector<double> band_matrix::lu_solve(const std::vector<double>& b,
-        bool is_lu_decomposed)
+// arc length of a segment from h0 to h1, 5 point Gauss-Legendre
+// quadrature on each of the panels, exact for polynomials up to degree 9
+// so one panel is plenty for short steps along a smooth curve and a few
+// keep whole segments accurate even when the curve turns sharply
+double curve_arc_length(const curve_segment& q, double h0, double h1,
+                        int panels=1)
 {
-    assert( this->dim()==(int)b.size() );
-    std::vector<double>  x,y;
-    if(is_lu_decomposed==false) {
-        this->lu_decompose();
-    }
-    y=this->l_solve(b);
-    x=this->r_solve(y);
-    return x;
+    static const double node[5]= {
+        -0.9061798459386640, -0.5384693101056831, 0.0,
+        0.5384693101056831, 0.9061798459386640
+    };
+    static const double weight[5]= {
+        0.2369268850561891, 0.4786286704993665, 0.5688888888888889,
+        0.4786286704993665, 0.2369268850561891
+    };
+    double half=0.5*(h1-h0)/panels;
+    double sum=0.0;
+    for(int p=0; p<panels; p++) {
+        double mid=h0+(2*p+1)*half;
+        for(int i=0; i<5; i++) {
+            sum+=weight[i]*curve_speed(q, mid+half*node[i]);
+        }
+    }
+    return half*sum;
 }
 
+// panels for integrals over whole segments
+const int segment_panels=4;
 
+void piecewise_arc_length(const plane_curve& r, double* len)
+{
+    len[0]=0.0;
+    for(int i=0; i<r.n-1; i++) {
+        len[i+1]=len[i]+curve_arc_length(curve_segment_at(r, i), 0.0,
+                                         r.t[i+1]-r.t[i], segment_panels);
+    }
+}
 
+double piecewise_arc_length_at(const plane_curve& r, const double* len,
+                               double t)
+{
+    // same segments as operator(), the left extrapolation runs backwards
+    // from t[0]
+    if(t<r.t[0]) {
+        return curve_arc_length(curve_segment_at(r, -1), 0.0, t-r.t[0],
+                                segment_panels);
+    }
+    int seg=std::max(int(std::lower_bound(r.t, r.t+r.n, t)-r.t)-1, 0);
+    return len[seg]+curve_arc_length(curve_segment_at(r, seg), 0.0,
+                                     t-r.t[seg], segment_panels);
+}
 
-// spline implementation
-// -----------------------
-
-void spline::set_boundary(spline::bd_type left, double left_value,
-                          spline::bd_type right, double right_value,
-                          bool force_linear_extrapolation)
+void piecewise_sample_arc_length(const plane_curve& r, const double* len,
+                                 double s0, double ds, size_t count,
+                                 double* ts)
 {
-    assert(m_x.size()==0);          // set_points() must not have happened yet
-    m_left=left;
-    m_right=right;
-    m_left_value=left_value;
-    m_right_value=right_value;
-    m_force_linear_extrapolation=force_linear_extrapolation;
+    // Newton converges quadratically, so once a step is below 1e-6 the
+    // remaining error is far below that
+    const int    max_iterations=8;
+    const double tolerance=1e-6;
+    const int    n=r.n;
+    int    seg=-2;
+    double h=0.0, h_s=0.0;    // last solution and its arc length
+    curve_segment q=curve_segment_at(r, -1);
+    for(size_t k=0; k<count; k++) {
+        double s=s0+(k+1)*ds;
+        // segment by arc length, a monotone cursor for ds>=0
+        int last=seg;
+        if(s<0.0) {
+            seg=-1;
+        } else {
+            if(seg<0 || s<len[seg]) {
+                seg=std::max(int(std::lower_bound(len, len+n, s)-len)-1, 0);
+            }
+            while(seg<n-1 && s>len[seg+1]) seg++;
+        }
+        int i=std::max(seg, 0);
+
+        // integrate from the previous point when it is on the same piece,
+        // a second order Taylor step of t(s) from there is a close first
+        // guess, otherwise start at the knot from the chord of the segment
+        // (or the knot tangent at the ends)
+        double from;
+        if(seg==last) {
+            from=h;
+            double dx=(3.0*q.xa*h + 2.0*q.xb)*h + q.xc;
+            double dy=(3.0*q.ya*h + 2.0*q.yb)*h + q.yc;
+            double ddx=6.0*q.xa*h + 2.0*q.xb;
+            double ddy=6.0*q.ya*h + 2.0*q.yb;
+            double v2=dx*dx+dy*dy;
+            double step=s-h_s;
+            h+=step/std::sqrt(v2) - 0.5*step*step*(dx*ddx+dy*ddy)/(v2*v2);
+        } else {
+            q=curve_segment_at(r, seg);
+            from=0.0;
+            h_s=len[i];
+            if(seg>=0 && seg<n-1) {
+                h=(s-h_s)/(len[seg+1]-len[seg])*(r.t[seg+1]-r.t[seg]);
+            } else {
+                h=(s-h_s)/curve_speed(q, 0.0);
+            }
+        }
+        double target=s-h_s;
+        int    panels=(seg==last) ? 1 : segment_panels;
+        for(int it=0; it<max_iterations; it++) {
+            double step=(curve_arc_length(q, from, h, panels)-target)
+                        / curve_speed(q, h);
+            h-=step;
+            if(std::fabs(step)<tolerance) break;
+        }
+        h_s=s;
+        ts[k]=r.t[i]+h;
+    }
 }
 
+// spline implementation
+// -----------------------
 
-void spline::set_points(const std::vector<double>& x,
-                        const std::vector<double>& y, bool cubic_spline)
+void spline::fit(bool cubic_spline)
 {
-    assert(x.size()==y.size());
+    const std::vector<double>& x=m_x;
+    const std::vector<double>& y=m_y;
     assert(x.size()>2);
-    m_x=x;
-    m_y=y;
     int   n=x.size();
     // TODO: maybe sort x and y, rather than returning an error
     for(int i=0; i<n-1; i++) {
@@ -295,49 +827,54 @@ void spline::set_points(const std::vector<double>& x,
     }
 
     if(cubic_spline==true) { // cubic spline interpolation
-        // setting up the matrix and right hand side of the equation system
-        // for the parameters b[]
-        band_matrix A(n,1,1);
-        std::vector<double>  rhs(n);
+        // setting up the tridiagonal matrix and right hand side of the
+        // equation system for the parameters b[], the right hand side is
+        // stored in m_b which receives the solution
+        m_work.resize(3*n);
+        double* lower=&m_work[0];
+        double* diag=&m_work[n];
+        double* upper=&m_work[2*n];
+        m_b.resize(n);
         for(int i=1; i<n-1; i++) {
-            A(i,i-1)=1.0/3.0*(x[i]-x[i-1]);
-            A(i,i)=2.0/3.0*(x[i+1]-x[i-1]);
-            A(i,i+1)=1.0/3.0*(x[i+1]-x[i]);
-            rhs[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+            lower[i]=1.0/3.0*(x[i]-x[i-1]);
+            diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+            upper[i]=1.0/3.0*(x[i+1]-x[i]);
+            m_b[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
         }
         // boundary conditions
         if(m_left == spline::second_deriv) {
             // 2*b[0] = f''
-            A(0,0)=2.0;
-            A(0,1)=0.0;
-            rhs[0]=m_left_value;
+            diag[0]=2.0;
+            upper[0]=0.0;
+            m_b[0]=m_left_value;
         } else if(m_left == spline::first_deriv) {
             // c[0] = f', needs to be re-expressed in terms of b:
             // (2b[0]+b[1])(x[1]-x[0]) = 3 ((y[1]-y[0])/(x[1]-x[0]) - f')
-            A(0,0)=2.0*(x[1]-x[0]);
-            A(0,1)=1.0*(x[1]-x[0]);
-            rhs[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+            diag[0]=2.0*(x[1]-x[0]);
+            upper[0]=1.0*(x[1]-x[0]);
+            m_b[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
         } else {
             assert(false);
         }
         if(m_right == spline::second_deriv) {
             // 2*b[n-1] = f''
-            A(n-1,n-1)=2.0;
-            A(n-1,n-2)=0.0;
-            rhs[n-1]=m_right_value;
+            diag[n-1]=2.0;
+            lower[n-1]=0.0;
+            m_b[n-1]=m_right_value;
         } else if(m_right == spline::first_deriv) {
             // c[n-1] = f', needs to be re-expressed in terms of b:
             // (b[n-2]+2b[n-1])(x[n-1]-x[n-2])
             // = 3 (f' - (y[n-1]-y[n-2])/(x[n-1]-x[n-2]))
-            A(n-1,n-1)=2.0*(x[n-1]-x[n-2]);
-            A(n-1,n-2)=1.0*(x[n-1]-x[n-2]);
-            rhs[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
+            diag[n-1]=2.0*(x[n-1]-x[n-2]);
+            lower[n-1]=1.0*(x[n-1]-x[n-2]);
+            m_b[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
         } else {
             assert(false);
         }
 
-        // solve the equation system to obtain the parameters b[]
-        m_b=A.lu_solve(rhs);
+        // solve the equation system to obtain the parameters b[],
+        // a single O(n) pass without allocations
+        tridiagonal_solve(n, lower, diag, upper, &m_b[0]);
 
         // calculate parameters a[] and c[] based on b[]
         m_a.resize(n);
@@ -370,24 +907,199 @@ void spline::set_points(const std::vector<double>& x,
     m_c[n-1]=3.0*m_a[n-2]*h*h+2.0*m_b[n-2]*h+m_c[n-2];   // = f'_{n-2}(x_{n-1})
     if(m_force_linear_extrapolation==true)
         m_b[n-1]=0.0;
+
+    m_len.resize(n);
+    piecewise_arc_length(graph(), &m_len[0]);
+}
+
+
+// periodic_spline implementation
+// -------------------------
+
+void periodic_spline::set_points(const std::vector<double>& x,
+                                 const std::vector<double>& y, double period)
+{
+    assert(x.size()==y.size());
+    assert(x.size()>2);
+    int n=x.size();
+    for(int i=0; i<n-1; i++) {
+        assert(x[i]<x[i+1]);
+    }
+    assert(x[n-1]<x[0]+period);
+    m_x=x;
+    m_y=y;
+    m_period=period;
+
+    // the system of spline::set_points(), but every row has both neighbours
+    // (cyclic), h[i] is the length of segment i
+    m_work.resize(6*n);
+    double* lower=&m_work[0];
+    double* diag=&m_work[n];
+    double* upper=&m_work[2*n];
+    double* h=&m_work[3*n];
+    for(int i=0; i<n; i++) {
+        h[i]=(i<n-1) ? x[i+1]-x[i] : x[0]+period-x[n-1];
+    }
+    m_b.resize(n);
+    for(int i=0; i<n; i++) {
+        int prev=(i+n-1)%n;
+        int next=(i+1)%n;
+        lower[i]=1.0/3.0*h[prev];
+        diag[i]=2.0/3.0*(h[prev]+h[i]);
+        upper[i]=1.0/3.0*h[i];
+        m_b[i]=(y[next]-y[i])/h[i] - (y[i]-y[prev])/h[prev];
+    }
+    cyclic_tridiagonal_solve(n, lower, diag, upper, &m_b[0], &m_work[4*n]);
+
+    m_a.resize(n);
+    m_c.resize(n);
+    for(int i=0; i<n; i++) {
+        int next=(i+1)%n;
+        m_a[i]=1.0/3.0*(m_b[next]-m_b[i])/h[i];
+        m_c[i]=(y[next]-y[i])/h[i] - 1.0/3.0*(2.0*m_b[i]+m_b[next])*h[i];
+    }
+
+    // about one point per bucket, so a lookup walks a step or two
+    m_bucket_len=period/n;
+    m_bucket.resize(n);
+    int seg=0;
+    for(int k=0; k<n; k++) {
+        double start=x[0]+k*m_bucket_len;
+        while(seg<n-1 && x[seg+1]<=start) seg++;
+        m_bucket[k]=seg;
+    }
+}
+
+double periodic_spline::operator() (double x) const
+{
+    int n=m_x.size();
+    // wrap into [x_0, x_0+period)
+    double u=x-m_x[0];
+    u-=m_period*std::floor(u/m_period);
+    if(u>=m_period) u=0.0;
+    x=m_x[0]+u;
+
+    int seg=m_bucket[std::min(int(u/m_bucket_len), n-1)];
+    while(seg<n-1 && m_x[seg+1]<=x) seg++;
+
+    double h=x-m_x[seg];
+    return ((m_a[seg]*h + m_b[seg])*h + m_c[seg])*h + m_y[seg];
+}
+
+
+// fixed_spline implementation
+// -------------------------
+
+template<int N>
+void fixed_spline<N>::set_boundary(bd_type left, double left_value,
+                                   bd_type right, double right_value,
+                                   bool force_linear_extrapolation)
+{
+    m_left=left;
+    m_right=right;
+    m_left_value=left_value;
+    m_right_value=right_value;
+    m_force_linear_extrapolation=force_linear_extrapolation;
 }
 
-double spline::operator() (double x) const
+template<int N>
+void fixed_spline<N>::set_points(const double* x, const double* y,
+                                 bool cubic_spline)
 {
-    size_t n=m_x.size();
-    // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
-    std::vector<double>::const_iterator it;
-    it=std::lower_bound(m_x.begin(),m_x.end(),x);
-    int idx=std::max( int(it-m_x.begin())-1, 0);
+    for(int i=0; i<N; i++) {
+        m_x[i]=x[i];
+        m_y[i]=y[i];
+    }
+    for(int i=0; i<N-1; i++) {
+        assert(m_x[i]<m_x[i+1]);
+    }
+
+    if(cubic_spline==true) { // cubic spline interpolation
+        // same system as spline::set_points(), m_b holds the right hand
+        // side and receives the solution
+        double lower[N], diag[N], upper[N];
+        for(int i=1; i<N-1; i++) {
+            lower[i]=1.0/3.0*(x[i]-x[i-1]);
+            diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+            upper[i]=1.0/3.0*(x[i+1]-x[i]);
+            m_b[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+        }
+        // boundary conditions
+        if(m_left == second_deriv) {
+            diag[0]=2.0;
+            upper[0]=0.0;
+            m_b[0]=m_left_value;
+        } else {
+            diag[0]=2.0*(x[1]-x[0]);
+            upper[0]=1.0*(x[1]-x[0]);
+            m_b[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+        }
+        if(m_right == second_deriv) {
+            diag[N-1]=2.0;
+            lower[N-1]=0.0;
+            m_b[N-1]=m_right_value;
+        } else {
+            diag[N-1]=2.0*(x[N-1]-x[N-2]);
+            lower[N-1]=1.0*(x[N-1]-x[N-2]);
+            m_b[N-1]=3.0*(m_right_value-(y[N-1]-y[N-2])/(x[N-1]-x[N-2]));
+        }
+
+        // Thomas algorithm, see tridiagonal_solve()
+        for(int i=1; i<N; i++) {
+            double w=lower[i]/diag[i-1];
+            diag[i] -= w*upper[i-1];
+            m_b[i] -= w*m_b[i-1];
+        }
+        m_b[N-1] /= diag[N-1];
+        for(int i=N-2; i>=0; i--) {
+            m_b[i]=(m_b[i]-upper[i]*m_b[i+1])/diag[i];
+        }
+
+        // calculate parameters a[] and c[] based on b[]
+        for(int i=0; i<N-1; i++) {
+            m_a[i]=1.0/3.0*(m_b[i+1]-m_b[i])/(x[i+1]-x[i]);
+            m_c[i]=(y[i+1]-y[i])/(x[i+1]-x[i])
+                   - 1.0/3.0*(2.0*m_b[i]+m_b[i+1])*(x[i+1]-x[i]);
+        }
+    } else { // linear interpolation
+        for(int i=0; i<N-1; i++) {
+            m_a[i]=0.0;
+            m_b[i]=0.0;
+            m_c[i]=(m_y[i+1]-m_y[i])/(m_x[i+1]-m_x[i]);
+        }
+        m_b[N-1]=0.0;   // std::array is not zeroed, unlike spline's vectors
+    }
+
+    // extrapolation coefficients, see spline::set_points()
+    m_b0 = (m_force_linear_extrapolation==false) ? m_b[0] : 0.0;
+    m_c0 = m_c[0];
+    double h=x[N-1]-x[N-2];
+    m_a[N-1]=0.0;
+    m_c[N-1]=3.0*m_a[N-2]*h*h+2.0*m_b[N-2]*h+m_c[N-2];
+    if(m_force_linear_extrapolation==true)
+        m_b[N-1]=0.0;
+
+    piecewise_arc_length(graph(), m_len.data());
+}
+
+template<int N>
+double fixed_spline<N>::operator() (double x) const
+{
+    // closest point m_x[idx] < x, idx=0 even if x<m_x[0], a linear scan
+    // beats the binary search for the few points
+    int idx=0;
+    for(int i=1; i<N; i++) {
+        if(m_x[i]<x) idx=i;
+    }
 
     double h=x-m_x[idx];
     double interpol;
     if(x<m_x[0]) {
         // extrapolation to the left
         interpol=(m_b0*h + m_c0)*h + m_y[0];
-    } else if(x>m_x[n-1]) {
+    } else if(x>m_x[N-1]) {
         // extrapolation to the right
-        interpol=(m_b[n-1]*h + m_c[n-1])*h + m_y[n-1];
+        interpol=(m_b[N-1]*h + m_c[N-1])*h + m_y[N-1];
     } else {
         // interpolation
         interpol=((m_a[idx]*h + m_b[idx])*h + m_c[idx])*h + m_y[idx];
@@ -396,6 +1108,169 @@ double spline::operator() (double x) const
 }
 
 
+// fixed_spline2d implementation
+// -------------------------
+
+template<int N>
+void fixed_spline2d<N>::set_points(const double* x, const double* y)
+{
+    m_t[0]=0.0;
+    for(int i=0; i<N; i++) {
+        m_x[i]=x[i];
+        m_y[i]=y[i];
+        if(i>0) {
+            m_t[i]=m_t[i-1]+std::sqrt((x[i]-x[i-1])*(x[i]-x[i-1])
+                                      +(y[i]-y[i-1])*(y[i]-y[i-1]));
+            assert(m_t[i-1]<m_t[i]);
+        }
+    }
+    const std::array<double,N>& t=m_t;
+
+    // the system of spline::set_points() with natural boundaries, x and y
+    // are two right hand sides of the same matrix, m_xb and m_yb hold them
+    // and receive the solutions
+    double lower[N], diag[N], upper[N];
+    for(int i=1; i<N-1; i++) {
+        lower[i]=1.0/3.0*(t[i]-t[i-1]);
+        diag[i]=2.0/3.0*(t[i+1]-t[i-1]);
+        upper[i]=1.0/3.0*(t[i+1]-t[i]);
+        m_xb[i]=(x[i+1]-x[i])/(t[i+1]-t[i]) - (x[i]-x[i-1])/(t[i]-t[i-1]);
+        m_yb[i]=(y[i+1]-y[i])/(t[i+1]-t[i]) - (y[i]-y[i-1])/(t[i]-t[i-1]);
+    }
+    diag[0]=2.0;
+    upper[0]=0.0;
+    m_xb[0]=m_yb[0]=0.0;
+    diag[N-1]=2.0;
+    lower[N-1]=0.0;
+    m_xb[N-1]=m_yb[N-1]=0.0;
+
+    // Thomas algorithm, the elimination is done once for both
+    for(int i=1; i<N; i++) {
+        double w=lower[i]/diag[i-1];
+        diag[i] -= w*upper[i-1];
+        m_xb[i] -= w*m_xb[i-1];
+        m_yb[i] -= w*m_yb[i-1];
+    }
+    m_xb[N-1] /= diag[N-1];
+    m_yb[N-1] /= diag[N-1];
+    for(int i=N-2; i>=0; i--) {
+        m_xb[i]=(m_xb[i]-upper[i]*m_xb[i+1])/diag[i];
+        m_yb[i]=(m_yb[i]-upper[i]*m_yb[i+1])/diag[i];
+    }
+
+    for(int i=0; i<N-1; i++) {
+        double h=t[i+1]-t[i];
+        m_xa[i]=1.0/3.0*(m_xb[i+1]-m_xb[i])/h;
+        m_xc[i]=(x[i+1]-x[i])/h - 1.0/3.0*(2.0*m_xb[i]+m_xb[i+1])*h;
+        m_ya[i]=1.0/3.0*(m_yb[i+1]-m_yb[i])/h;
+        m_yc[i]=(y[i+1]-y[i])/h - 1.0/3.0*(2.0*m_yb[i]+m_yb[i+1])*h;
+    }
+
+    // extrapolation coefficients, see spline::set_points()
+    m_xb0=m_xb[0];
+    m_xc0=m_xc[0];
+    m_yb0=m_yb[0];
+    m_yc0=m_yc[0];
+    double h=t[N-1]-t[N-2];
+    m_xa[N-1]=0.0;
+    m_xc[N-1]=3.0*m_xa[N-2]*h*h+2.0*m_xb[N-2]*h+m_xc[N-2];
+    m_ya[N-1]=0.0;
+    m_yc[N-1]=3.0*m_ya[N-2]*h*h+2.0*m_yb[N-2]*h+m_yc[N-2];
+
+    piecewise_arc_length(curve(), m_len.data());
+}
+
+
+// spline_pack implementation
+// -------------------------
+
+template<int N>
+void spline_pack<N>::add(const fixed_spline<N>& s)
+{
+    int lane=m_size%4;
+    if(lane==0) {
+        // unused lanes of the last block evaluate to 0
+        m_blocks.push_back(block());
+        std::fill(&m_blocks.back().knot[0][0],
+                  &m_blocks.back().knot[0][0]+sizeof(block)/sizeof(double),
+                  0.0);
+    }
+    block& bk=m_blocks.back();
+    bk.knot[0][lane]=s.m_x[0];
+    bk.a[0][lane]=0.0;
+    bk.b[0][lane]=s.m_b0;
+    bk.c[0][lane]=s.m_c0;
+    bk.y[0][lane]=s.m_y[0];
+    for(int i=0; i<N; i++) {
+        bk.knot[i+1][lane]=s.m_x[i];
+        bk.a[i+1][lane]=s.m_a[i];
+        bk.b[i+1][lane]=s.m_b[i];
+        bk.c[i+1][lane]=s.m_c[i];
+        bk.y[i+1][lane]=s.m_y[i];
+    }
+    m_size++;
+}
+
+// the piece of a spline is the last one whose start lies before x, as
+// in fixed_spline::operator() x at a knot belongs to the segment before
+// it, except for the first knot
+template<int N>
+void spline_pack<N>::evaluate_scalar(double x, double* out) const
+{
+    for(size_t k=0; k<m_size; k++) {
+        const block& bk=m_blocks[k/4];
+        int lane=k%4;
+        int p=(x>=bk.knot[1][lane]) ? 1 : 0;
+        for(int i=2; i<=N; i++) {
+            if(x>bk.knot[i][lane]) p=i;
+        }
+        double h=x-bk.knot[p][lane];
+        out[k]=((bk.a[p][lane]*h + bk.b[p][lane])*h + bk.c[p][lane])*h
+               + bk.y[p][lane];
+    }
+}
+
+#ifdef TK_SPLINE_X86
+// the piece is picked by blending in the coefficients of every later
+// piece that starts before x, the starts increase so the last one wins
+template<int N>
+__attribute__((target("avx2")))
+void spline_pack<N>::evaluate_avx2(double x, double* out) const
+{
+    const __m256d x_v=_mm256_set1_pd(x);
+    for(size_t j=0; j<m_blocks.size(); j++) {
+        const block& bk=m_blocks[j];
+        __m256d knot=_mm256_loadu_pd(bk.knot[0]);
+        __m256d a=_mm256_loadu_pd(bk.a[0]);
+        __m256d b=_mm256_loadu_pd(bk.b[0]);
+        __m256d c=_mm256_loadu_pd(bk.c[0]);
+        __m256d y=_mm256_loadu_pd(bk.y[0]);
+        for(int i=1; i<=N; i++) {
+            __m256d start=_mm256_loadu_pd(bk.knot[i]);
+            __m256d in=(i==1) ? _mm256_cmp_pd(x_v, start, _CMP_GE_OQ)
+                       : _mm256_cmp_pd(x_v, start, _CMP_GT_OQ);
+            knot=_mm256_blendv_pd(knot, start, in);
+            a=_mm256_blendv_pd(a, _mm256_loadu_pd(bk.a[i]), in);
+            b=_mm256_blendv_pd(b, _mm256_loadu_pd(bk.b[i]), in);
+            c=_mm256_blendv_pd(c, _mm256_loadu_pd(bk.c[i]), in);
+            y=_mm256_blendv_pd(y, _mm256_loadu_pd(bk.y[i]), in);
+        }
+        __m256d h=_mm256_sub_pd(x_v, knot);
+        __m256d r=_mm256_add_pd(_mm256_mul_pd(a, h), b);
+        r=_mm256_add_pd(_mm256_mul_pd(r, h), c);
+        r=_mm256_add_pd(_mm256_mul_pd(r, h), y);
+        if(4*j+4<=m_size) {
+            _mm256_storeu_pd(out+4*j, r);
+        } else {
+            double last[4];
+            _mm256_storeu_pd(last, r);
+            for(size_t k=4*j; k<m_size; k++) out[k]=last[k-4*j];
+        }
+    }
+}
+#endif
+
+
 } // namespace tk
 
 
@@ -0,0 +1,90 @@
+#ifndef VEHICLE_TABLE_H
+#define VEHICLE_TABLE_H
+
+#include <vector>
+#include <math.h>
+#include "map.h"
+
+// Largest sensor fusion id the table stores, the simulator numbers its vehicles from 0,
+// so a larger id is a corrupted message and must not size the table
+const int kMaxVehicleId = 1023;
+
+// Everything the planner knows about one sensor fusion vehicle
+struct VehicleState {
+    bool present = false;
+    double x = 0;
+    double y = 0;
+    double vx = 0;
+    double vy = 0;
+    double s = 0;
+    double d = 0;
+    // derived once per frame
+    double speed = 0;
+    int lane = -1;
+    // warm start for converting this vehicle's (predicted) positions to Frenet
+    MapCursor cursor;
+};
+
+// Dense table of the sensor fusion vehicles indexed by their id.
+// update() refreshes it from each frame's sensor fusion list, vehicles missing
+// from the list are evicted, so their cursor does not leak into a new vehicle
+// that later gets the same id.
+class VehicleTable {
+public:
+    // sensor fusion entries are [id, x, y, vx, vy, s, d]
+    void update(const std::vector<std::vector<double>> &sensor_fusion, const Map &map) {
+        for (size_t k = 0; k < m_active.size(); k++) {
+            m_states[m_active[k]].present = false;
+        }
+        m_seen.clear();
+        for (auto &&vehicle : sensor_fusion) {
+            // compared before the cast, which is undefined for ids out of the int range
+            if (!(vehicle[0] >= 0 && vehicle[0] <= kMaxVehicleId)) {
+                continue;
+            }
+            int id = (int) vehicle[0];
+            if (id >= (int) m_states.size()) {
+                m_states.resize(id + 1);
+            }
+            VehicleState &state = m_states[id];
+            if (!state.present) {
+                // an id listed twice in a frame stays a single active vehicle, the later entry wins
+                m_seen.push_back(id);
+            }
+            state.present = true;
+            state.x = vehicle[1];
+            state.y = vehicle[2];
+            state.vx = vehicle[3];
+            state.vy = vehicle[4];
+            state.s = vehicle[5];
+            state.d = vehicle[6];
+            state.speed = sqrt(state.vx * state.vx + state.vy * state.vy);
+            state.lane = LaneAt(state.s, state.d, map);
+        }
+        // evict vehicles that left the sensor range
+        for (size_t k = 0; k < m_active.size(); k++) {
+            if (!m_states[m_active[k]].present) {
+                m_states[m_active[k]] = VehicleState();
+            }
+        }
+        m_active.swap(m_seen);
+    }
+
+    // ids of the vehicles in the current frame
+    const std::vector<int> &active() const { return m_active; }
+
+    const VehicleState &operator[](int id) const { return m_states[id]; }
+
+    // Frenet s,d of a position of vehicle id, e.g. a predicted one,
+    // warm started from the last conversion for that vehicle
+    std::vector<double> getFrenet(int id, double x, double y, double theta, const Map &map) {
+        return ::getFrenet(x, y, theta, map, m_states[id].cursor);
+    }
+
+private:
+    std::vector<VehicleState> m_states;
+    std::vector<int> m_active;
+    std::vector<int> m_seen;
+};
+
+#endif /* VEHICLE_TABLE_H */
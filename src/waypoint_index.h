@@ -0,0 +1,249 @@
+#ifndef WAYPOINT_INDEX_H
+#define WAYPOINT_INDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include "binary_io.h"
+
+// Uniform grid over the segments of a closed waypoint loop.
+// Every cell stores the segments whose bounding box overlaps it, so nearest
+// waypoint and nearest segment queries only look at a few cells around the
+// query point instead of scanning the whole map.
+// The index is immutable after build() and can be shared between sessions.
+class WaypointIndex {
+public:
+    WaypointIndex() : m_min_x(0), m_min_y(0), m_cell_size(1), m_inv_cell_size(1), m_cols(0), m_rows(0) {}
+
+    // segment i connects waypoint i with waypoint (i + 1) % n
+    void build(const std::vector<double> &x, const std::vector<double> &y) {
+        int n = x.size();
+        m_cell_start.clear();
+        m_entries.clear();
+        m_cols = 0;
+        m_rows = 0;
+        if (n == 0) {
+            return;
+        }
+
+        double max_x = x[0];
+        double max_y = y[0];
+        double total_len = 0;
+        m_min_x = x[0];
+        m_min_y = y[0];
+        for (int i = 0; i < n; i++) {
+            int j = (i + 1) % n;
+            m_min_x = std::min(m_min_x, x[i]);
+            m_min_y = std::min(m_min_y, y[i]);
+            max_x = std::max(max_x, x[i]);
+            max_y = std::max(max_y, y[i]);
+            total_len += sqrt((x[j] - x[i]) * (x[j] - x[i]) + (y[j] - y[i]) * (y[j] - y[i]));
+        }
+
+        // roughly one cell per segment, but never smaller than an average segment
+        double width = max_x - m_min_x;
+        double height = max_y - m_min_y;
+        m_cell_size = std::max(total_len / n, sqrt(width * height / n));
+        if (m_cell_size <= 0) {
+            m_cell_size = 1;
+        }
+        m_inv_cell_size = 1.0 / m_cell_size;
+        m_cols = (int) (width * m_inv_cell_size) + 1;
+        m_rows = (int) (height * m_inv_cell_size) + 1;
+
+        // counting pass followed by a fill pass, so cell contents are contiguous
+        std::vector<int> count(m_cols * m_rows + 1, 0);
+        for (int pass = 0; pass < 2; pass++) {
+            if (pass == 1) {
+                m_cell_start.assign(count.size(), 0);
+                for (size_t c = 1; c < count.size(); c++) {
+                    m_cell_start[c] = m_cell_start[c - 1] + count[c - 1];
+                }
+                m_entries.resize(m_cell_start.back());
+                count.assign(count.size(), 0);
+            }
+            for (int i = 0; i < n; i++) {
+                int j = (i + 1) % n;
+                int c0 = col(std::min(x[i], x[j]));
+                int c1 = col(std::max(x[i], x[j]));
+                int r0 = row(std::min(y[i], y[j]));
+                int r1 = row(std::max(y[i], y[j]));
+                for (int r = r0; r <= r1; r++) {
+                    for (int c = c0; c <= c1; c++) {
+                        int cell = r * m_cols + c;
+                        if (pass == 1) {
+                            Entry &e = m_entries[m_cell_start[cell] + count[cell]];
+                            e.ax = x[i];
+                            e.ay = y[i];
+                            e.bx = x[j];
+                            e.by = y[j];
+                            e.a = i;
+                            e.b = j;
+                        }
+                        count[cell]++;
+                    }
+                }
+            }
+        }
+    }
+
+    bool empty() const { return m_entries.empty(); }
+
+    void save(BinaryWriter &out) const {
+        out.value(m_min_x);
+        out.value(m_min_y);
+        out.value(m_cell_size);
+        out.value(m_cols);
+        out.value(m_rows);
+        out.array(m_cell_start);
+        out.array(m_entries);
+    }
+
+    bool load(BinaryReader &in) {
+        in.value(m_min_x);
+        in.value(m_min_y);
+        in.value(m_cell_size);
+        in.value(m_cols);
+        in.value(m_rows);
+        in.array(m_cell_start);
+        in.array(m_entries);
+        m_inv_cell_size = 1.0 / m_cell_size;
+        // the cell table has to match the grid and point into the entries
+        if (!in.ok() || !(m_cell_size > 0) || !isfinite(m_cell_size) || !isfinite(m_inv_cell_size) || !isfinite(m_min_x) ||
+            !isfinite(m_min_y) || m_cols < 0 || m_rows < 0 ||
+            m_cell_start.size() != (size_t) m_cols * (size_t) m_rows + 1 ||
+            m_cell_start.front() != 0 || m_cell_start.back() != (int) m_entries.size()) {
+            return false;
+        }
+        for (size_t c = 1; c < m_cell_start.size(); c++) {
+            if (m_cell_start[c] < m_cell_start[c - 1]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether every entry refers to waypoints of a map with n waypoints,
+    // a loaded index is only safe to query after this held
+    bool indexes_waypoints(size_t n) const {
+        for (size_t k = 0; k < m_entries.size(); k++) {
+            if (m_entries[k].a < 0 || m_entries[k].a >= (int) n || m_entries[k].b < 0 || m_entries[k].b >= (int) n) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // index of the waypoint closest to x,y
+    int closest_waypoint(double x, double y) const {
+        Best best;
+        search(x, y, best, false);
+        return best.index;
+    }
+
+    // index i of the segment (waypoint i to waypoint i + 1) closest to x,y
+    int closest_segment(double x, double y) const {
+        Best best;
+        search(x, y, best, true);
+        return best.index;
+    }
+
+private:
+    struct Entry {
+        double ax, ay, bx, by;
+        int a, b;
+    };
+
+    struct Best {
+        Best() : dist2(std::numeric_limits<double>::max()), index(0) {}
+        double dist2;
+        int index;
+    };
+
+    int col(double x) const {
+        return std::max(0, std::min(m_cols - 1, (int) ((x - m_min_x) * m_inv_cell_size)));
+    }
+
+    int row(double y) const {
+        return std::max(0, std::min(m_rows - 1, (int) ((y - m_min_y) * m_inv_cell_size)));
+    }
+
+    static void visit(const Entry &e, double x, double y, Best &best, bool segments) {
+        if (segments) {
+            double n_x = e.bx - e.ax;
+            double n_y = e.by - e.ay;
+            double x_x = x - e.ax;
+            double x_y = y - e.ay;
+            double len2 = n_x * n_x + n_y * n_y;
+            double t = len2 > 0 ? (x_x * n_x + x_y * n_y) / len2 : 0;
+            t = std::max(0.0, std::min(1.0, t));
+            double d_x = x_x - t * n_x;
+            double d_y = x_y - t * n_y;
+            double dist2 = d_x * d_x + d_y * d_y;
+            if (dist2 < best.dist2 || (dist2 == best.dist2 && e.a < best.index)) {
+                best.dist2 = dist2;
+                best.index = e.a;
+            }
+        } else {
+            // every waypoint is an endpoint of a segment stored in the cell the waypoint lies in
+            double dist2a = (x - e.ax) * (x - e.ax) + (y - e.ay) * (y - e.ay);
+            if (dist2a < best.dist2 || (dist2a == best.dist2 && e.a < best.index)) {
+                best.dist2 = dist2a;
+                best.index = e.a;
+            }
+            double dist2b = (x - e.bx) * (x - e.bx) + (y - e.by) * (y - e.by);
+            if (dist2b < best.dist2 || (dist2b == best.dist2 && e.b < best.index)) {
+                best.dist2 = dist2b;
+                best.index = e.b;
+            }
+        }
+    }
+
+    void visit_cell(int c, int r, double x, double y, Best &best, bool segments) const {
+        if (c < 0 || c >= m_cols || r < 0 || r >= m_rows) {
+            return;
+        }
+        int cell = r * m_cols + c;
+        for (int k = m_cell_start[cell]; k < m_cell_start[cell + 1]; k++) {
+            visit(m_entries[k], x, y, best, segments);
+        }
+    }
+
+    // visits rings of cells around the query cell until no unvisited cell can hold a closer candidate
+    void search(double x, double y, Best &best, bool segments) const {
+        if (m_entries.empty()) {
+            return;
+        }
+        int qc = col(x);
+        int qr = row(y);
+        int max_ring = std::max(m_cols, m_rows);
+        for (int ring = 0; ring <= max_ring; ring++) {
+            if (ring == 0) {
+                visit_cell(qc, qr, x, y, best, segments);
+            } else {
+                for (int c = qc - ring; c <= qc + ring; c++) {
+                    visit_cell(c, qr - ring, x, y, best, segments);
+                    visit_cell(c, qr + ring, x, y, best, segments);
+                }
+                for (int r = qr - ring + 1; r <= qr + ring - 1; r++) {
+                    visit_cell(qc - ring, r, x, y, best, segments);
+                    visit_cell(qc + ring, r, x, y, best, segments);
+                }
+            }
+            // cells of the next ring are at least ring * cell size away from x,y
+            double bound = ring * m_cell_size;
+            if (best.dist2 <= bound * bound) {
+                break;
+            }
+        }
+    }
+
+    double m_min_x, m_min_y;
+    double m_cell_size, m_inv_cell_size;
+    int m_cols, m_rows;
+    std::vector<int> m_cell_start;      // first entry of every cell, one extra element at the end
+    std::vector<Entry> m_entries;       // segments ordered by cell
+};
+
+#endif /* WAYPOINT_INDEX_H */